@@ -0,0 +1,32 @@
+// Host stand-in for <avr/interrupt.h>. Building main.c with -DHOST_BUILD -Ihost
+// picks this up instead of the avr-libc header: every I/O register becomes a
+// plain variable (defined in host/avr_host.c) and ISRs become plain functions
+// that the host harness calls when it wants the interrupt to "fire".
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+// Ports
+extern volatile unsigned char PORTA, PORTB, PORTC, PORTD;
+extern volatile unsigned char DDRA, DDRB, DDRC, DDRD;
+extern volatile unsigned char PINA, PINB, PINC, PIND;
+
+// Timer 1
+extern volatile unsigned char TCCR1A, TCCR1B, TIMSK1;
+extern volatile unsigned short OCR1A, TCNT1;
+
+// USART0
+extern volatile unsigned char UBRR0H, UBRR0L, UCSR0A, UCSR0B, UCSR0C, UDR0;
+
+// SPI
+extern volatile unsigned char SPCR, SPSR, SPDR;
+
+// Pin change interrupts, sleep mode
+extern volatile unsigned char PCICR, PCIFR, PCMSK2, SMCR;
+
+extern volatile unsigned char SREG;
+
+#define ISR(vector) void vector(void)
+#define sei() (SREG |= 0x80)
+#define cli() (SREG &= ~0x80)
+
+#endif
@@ -0,0 +1,9 @@
+// Host stand-in for <avr/pgmspace.h>: there is only one address space on the
+// PC, so PROGMEM data is ordinary const data and reading it is a plain load.
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const unsigned char *)(address))
+
+#endif
@@ -0,0 +1,846 @@
+// ATmega1284 core and peripherals, see avr_cpu.h. Cycle counts are the
+// "#Clocks" column of the ATmega1284 instruction set summary.
+#include <string.h>
+#include "avr_cpu.h"
+
+// SREG bits
+#define C_FLAG 0x01
+#define Z_FLAG 0x02
+#define N_FLAG 0x04
+#define V_FLAG 0x08
+#define S_FLAG 0x10
+#define H_FLAG 0x20
+#define T_FLAG 0x40
+#define I_FLAG 0x80
+
+//--------Peripherals---------------------------------------------------------
+
+static const unsigned long TimerPrescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static const unsigned long SpiDivider[4] = { 4, 16, 64, 128 };
+
+// Power-down, power-save and standby stop the I/O clock; idle and ADC noise reduction do not
+static int ClockStopped(const AvrCpu *cpu)
+{
+	return cpu->sleeping && ((cpu->data[AVR_SMCR] >> 1) & 0x07) >= 2;
+}
+
+static unsigned long TxFrame(const AvrCpu *cpu)
+{
+	unsigned long ubrr = cpu->data[AVR_UBRR0L] | (cpu->data[AVR_UBRR0H] & 0x0F) << 8;
+
+	return 16 * (ubrr + 1) * 10; // Start bit, 8 data bits, stop bit
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Lets the peripherals run for a number of cycles
+//Parameter: The CPU, cycles
+//Returns: Nothing
+static void Advance(AvrCpu *cpu, unsigned long n)
+{
+	unsigned char *d = cpu->data;
+	unsigned long prescale = TimerPrescale[d[AVR_TCCR1B] & 0x07];
+	unsigned short count, top;
+
+	cpu->clock += n;
+	if(ClockStopped(cpu)){
+		return;
+	}
+	if(prescale){
+		cpu->timer_prescale += n;
+		count = d[AVR_TCNT1L] | d[AVR_TCNT1H] << 8;
+		top = d[AVR_OCR1AL] | d[AVR_OCR1AH] << 8;
+		while(cpu->timer_prescale >= prescale){
+			cpu->timer_prescale -= prescale;
+			// CTC (WGM12) clears the count on the timer clock after the match
+			count = ((d[AVR_TCCR1B] & 0x08) && count == top) ? 0 : count + 1;
+			if(count == top){
+				d[AVR_TIFR1] |= 0x02; // OCF1A
+			}
+		}
+		d[AVR_TCNT1L] = count & 0xFF;
+		d[AVR_TCNT1H] = count >> 8;
+	}
+	if(cpu->tx_full && cpu->clock >= cpu->tx_done){
+		// The waiting byte moves into the shift register, UDR0 is free again
+		cpu->tx_full = 0;
+		cpu->tx_done += TxFrame(cpu);
+		if(cpu->tx){
+			cpu->tx(cpu, d[AVR_UDR0]);
+		}
+		d[AVR_UCSR0A] |= 0x20; // UDRE0
+	}
+	if(cpu->spi_done && cpu->clock >= cpu->spi_done){
+		cpu->spi_done = 0;
+		d[AVR_SPSR] |= 0x80; // SPIF
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - When the peripherals next change something on their own
+//Parameter: The CPU
+//Returns: clock of the next Timer1 match, USART or SPI event; ~0 if none
+unsigned long long AvrNextEvent(const AvrCpu *cpu)
+{
+	const unsigned char *d = cpu->data;
+	unsigned long prescale = TimerPrescale[d[AVR_TCCR1B] & 0x07];
+	unsigned long long next = ~0ULL;
+	unsigned short count, top;
+
+	if(ClockStopped(cpu)){
+		return next;
+	}
+	if(prescale){
+		count = d[AVR_TCNT1L] | d[AVR_TCNT1H] << 8;
+		top = d[AVR_OCR1AL] | d[AVR_OCR1AH] << 8;
+		if((d[AVR_TCCR1B] & 0x08) && count == top){
+			count = 0;
+		}
+		else{
+			count++;
+		}
+		// Timer clocks until the count reaches top again, 16-bit wrap included
+		next = cpu->clock + prescale - cpu->timer_prescale
+			+ (unsigned long long)((unsigned short)(top - count)) * prescale;
+	}
+	if(cpu->tx_full && cpu->tx_done < next){
+		next = cpu->tx_done;
+	}
+	if(cpu->spi_done && cpu->spi_done < next){
+		next = cpu->spi_done;
+	}
+	return next;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Lets time pass without running instructions, for a sleeping
+//                CPU or a harness that skips an idle loop
+//Parameter: The CPU, clock to stop at
+//Returns: Nothing
+void AvrIdle(AvrCpu *cpu, unsigned long long until)
+{
+	unsigned long long next;
+
+	while(cpu->clock < until){
+		next = AvrNextEvent(cpu);
+		Advance(cpu, (next < until ? next : until) - cpu->clock);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Sets what the buttons put on the PORTC pins
+//Parameter: The CPU, PINC value
+//Returns: Nothing
+void AvrPins(AvrCpu *cpu, unsigned char pinc)
+{
+	// Pin change detection is asynchronous, it works in every sleep mode
+	if((cpu->pinc ^ pinc) & cpu->data[AVR_PCMSK2]){
+		cpu->data[AVR_PCIFR] |= 0x04; // PCIF2
+	}
+	cpu->pinc = pinc;
+}
+
+static unsigned char IoRead(AvrCpu *cpu, unsigned int addr)
+{
+	unsigned char *d = cpu->data;
+
+	switch(addr){
+		case AVR_PINC: return cpu->pinc;
+		case AVR_TCNT1L: cpu->temp = d[AVR_TCNT1H]; return d[AVR_TCNT1L];
+		case AVR_TCNT1H: return cpu->temp;
+		case AVR_SPDR: d[AVR_SPSR] &= ~0x80; return 0xFF; // Nothing on MISO
+		case AVR_UDR0: return 0x00;
+	}
+	return d[addr];
+}
+
+static void IoWrite(AvrCpu *cpu, unsigned int addr, unsigned char value)
+{
+	unsigned char *d = cpu->data;
+
+	switch(addr){
+		case AVR_TIFR1:
+		case AVR_PCIFR:
+			d[addr] &= ~value; // Flags clear by writing one
+			return;
+		case AVR_TCNT1H:
+		case AVR_OCR1AH:
+			cpu->temp = value;
+			return;
+		case AVR_TCNT1L:
+		case AVR_OCR1AL:
+			d[addr] = value;
+			d[addr + 1] = cpu->temp;
+			return;
+		case AVR_SPSR:
+			d[addr] = (d[addr] & 0xFE) | (value & 0x01); // Only SPI2X is writable
+			return;
+		case AVR_SPDR:
+			d[addr] = value;
+			d[AVR_SPSR] &= ~0x80;
+			if((d[AVR_SPCR] & 0x50) == 0x50){
+				// Enabled master: 8 bits at fosc/divider
+				cpu->spi_done = cpu->clock + 8 * SpiDivider[d[AVR_SPCR] & 0x03] / ((d[AVR_SPSR] & 0x01) ? 2 : 1);
+			}
+			return;
+		case AVR_UCSR0A:
+			d[addr] = (d[addr] & 0x20) | (value & 0x03);
+			return;
+		case AVR_UDR0:
+			if(!(d[AVR_UCSR0B] & 0x08)){
+				return; // TXEN0 off
+			}
+			d[addr] = value;
+			if(cpu->clock >= cpu->tx_done){
+				// Shift register idle: the byte goes straight out
+				cpu->tx_done = cpu->clock + TxFrame(cpu);
+				if(cpu->tx){
+					cpu->tx(cpu, value);
+				}
+			}
+			else{
+				cpu->tx_full = 1;
+				d[AVR_UCSR0A] &= ~0x20;
+			}
+			return;
+	}
+	d[addr] = value;
+}
+
+// Vector whose flag and enable are set, -1 if none; the lowest vector number wins
+static int Pending(const AvrCpu *cpu)
+{
+	const unsigned char *d = cpu->data;
+
+	if((d[AVR_PCICR] & 0x04) && (d[AVR_PCIFR] & 0x04)){
+		return AVR_VECTOR_PCINT2;
+	}
+	if((d[AVR_TIMSK1] & 0x02) && (d[AVR_TIFR1] & 0x02)){
+		return AVR_VECTOR_TIMER1_COMPA;
+	}
+	if((d[AVR_SPCR] & 0x80) && (d[AVR_SPSR] & 0x80)){
+		return AVR_VECTOR_SPI_STC;
+	}
+	if((d[AVR_UCSR0B] & 0x20) && (d[AVR_UCSR0A] & 0x20)){
+		return AVR_VECTOR_USART0_UDRE;
+	}
+	return -1;
+}
+
+// Taking the vector clears the flag of the ones that have one
+static void Acknowledge(AvrCpu *cpu, int vector)
+{
+	switch(vector){
+		case AVR_VECTOR_PCINT2: cpu->data[AVR_PCIFR] &= ~0x04; break;
+		case AVR_VECTOR_TIMER1_COMPA: cpu->data[AVR_TIFR1] &= ~0x02; break;
+		case AVR_VECTOR_SPI_STC: cpu->data[AVR_SPSR] &= ~0x80; break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Which interrupt the next AvrStep takes
+//Parameter: The CPU
+//Returns: Vector number, -1 if none (or interrupts are off)
+int AvrPending(const AvrCpu *cpu)
+{
+	return ((cpu->data[AVR_SREG] & I_FLAG) && !cpu->hold) ? Pending(cpu) : -1;
+}
+//--------End Peripherals-----------------------------------------------------
+
+//--------Core----------------------------------------------------------------
+
+static unsigned char Read(AvrCpu *cpu, unsigned int addr)
+{
+	if(addr < 0x20){
+		return cpu->data[addr];
+	}
+	if(addr < 0x100){
+		return IoRead(cpu, addr);
+	}
+	return addr < AVR_DATA_SIZE ? cpu->data[addr] : 0x00;
+}
+
+static void Write(AvrCpu *cpu, unsigned int addr, unsigned char value)
+{
+	if(addr < 0x20){
+		cpu->data[addr] = value;
+	}
+	else if(addr < 0x100){
+		IoWrite(cpu, addr, value);
+	}
+	else if(addr < AVR_DATA_SIZE){
+		cpu->data[addr] = value;
+	}
+}
+
+static void Push(AvrCpu *cpu, unsigned char value)
+{
+	unsigned int sp = cpu->data[AVR_SPL] | cpu->data[AVR_SPH] << 8;
+
+	Write(cpu, sp, value);
+	sp--;
+	cpu->data[AVR_SPL] = sp & 0xFF;
+	cpu->data[AVR_SPH] = (sp >> 8) & 0xFF;
+}
+
+static unsigned char Pop(AvrCpu *cpu)
+{
+	unsigned int sp = (cpu->data[AVR_SPL] | cpu->data[AVR_SPH] << 8) + 1;
+
+	cpu->data[AVR_SPL] = sp & 0xFF;
+	cpu->data[AVR_SPH] = (sp >> 8) & 0xFF;
+	return Read(cpu, sp & 0xFFFF);
+}
+
+// Return addresses go on the stack low byte first, so they read high byte first
+static void PushPc(AvrCpu *cpu, unsigned long pc)
+{
+	Push(cpu, pc & 0xFF);
+	Push(cpu, (pc >> 8) & 0xFF);
+}
+
+static unsigned long PopPc(AvrCpu *cpu)
+{
+	unsigned long pc = (unsigned long)Pop(cpu) << 8;
+
+	return pc | Pop(cpu);
+}
+
+static unsigned int Pair(const AvrCpu *cpu, int r)
+{
+	return cpu->data[r] | cpu->data[r + 1] << 8;
+}
+
+static void SetPair(AvrCpu *cpu, int r, unsigned int value)
+{
+	cpu->data[r] = value & 0xFF;
+	cpu->data[r + 1] = (value >> 8) & 0xFF;
+}
+
+// Sets the masked SREG bits to the given ones
+static void Flags(AvrCpu *cpu, unsigned char mask, unsigned char bits)
+{
+	cpu->data[AVR_SREG] = (cpu->data[AVR_SREG] & ~mask) | (bits & mask);
+}
+
+// N, S and Z (Z only set when keep_z allows it) from a result and its V
+static unsigned char Nzs(unsigned char r, unsigned char v, int z)
+{
+	unsigned char f = v ? V_FLAG : 0;
+
+	if(r & 0x80){
+		f |= N_FLAG;
+	}
+	if(!(r & 0x80) != !v){
+		f |= S_FLAG;
+	}
+	if(z && r == 0){
+		f |= Z_FLAG;
+	}
+	return f;
+}
+
+static unsigned char Add(AvrCpu *cpu, unsigned char d, unsigned char r, int carry)
+{
+	unsigned char res = d + r + carry;
+	unsigned char c = (d & r) | (r & ~res) | (~res & d);
+	unsigned char v = ((d & r & ~res) | (~d & ~r & res)) & 0x80;
+
+	Flags(cpu, H_FLAG | S_FLAG | V_FLAG | N_FLAG | Z_FLAG | C_FLAG,
+		Nzs(res, v, 1) | ((c & 0x08) ? H_FLAG : 0) | ((c & 0x80) ? C_FLAG : 0));
+	return res;
+}
+
+// SUB/SUBI/CP/CPI with keep_z 0; SBC/SBCI/CPC keep Z only while the result stays zero
+static unsigned char Sub(AvrCpu *cpu, unsigned char d, unsigned char r, int carry, int keep_z)
+{
+	unsigned char res = d - r - carry;
+	unsigned char c = (~d & r) | (r & res) | (res & ~d);
+	unsigned char v = ((d & ~r & ~res) | (~d & r & res)) & 0x80;
+	int z = keep_z ? (cpu->data[AVR_SREG] & Z_FLAG) != 0 : 1;
+
+	Flags(cpu, H_FLAG | S_FLAG | V_FLAG | N_FLAG | Z_FLAG | C_FLAG,
+		Nzs(res, v, z) | ((c & 0x08) ? H_FLAG : 0) | ((c & 0x80) ? C_FLAG : 0));
+	return res;
+}
+
+static unsigned char Logic(AvrCpu *cpu, unsigned char res)
+{
+	Flags(cpu, S_FLAG | V_FLAG | N_FLAG | Z_FLAG, Nzs(res, 0, 1));
+	return res;
+}
+
+// LSR, ROR and ASR: C from bit 0, V = N ^ C
+static unsigned char Shift(AvrCpu *cpu, unsigned char d, unsigned char res)
+{
+	unsigned char c = d & 0x01;
+	unsigned char n = res & 0x80;
+
+	Flags(cpu, S_FLAG | V_FLAG | N_FLAG | Z_FLAG | C_FLAG,
+		Nzs(res, !n != !c, 1) | (c ? C_FLAG : 0));
+	return res;
+}
+
+// MUL family: the 16-bit product goes to r1:r0, C is bit 15 before FMUL's shift
+static void Multiply(AvrCpu *cpu, long product, int fractional)
+{
+	unsigned int p = product & 0xFFFF;
+	unsigned char c = (p & 0x8000) != 0;
+
+	if(fractional){
+		p = (p << 1) & 0xFFFF;
+	}
+	SetPair(cpu, 0, p);
+	Flags(cpu, Z_FLAG | C_FLAG, (p == 0 ? Z_FLAG : 0) | (c ? C_FLAG : 0));
+}
+
+// LDS, STS, JMP and CALL take two words, a skip over them takes one cycle more
+static int TwoWords(unsigned short op)
+{
+	return (op & 0xFC0F) == 0x9000 || (op & 0xFE0E) == 0x940C;
+}
+
+static int Skip(AvrCpu *cpu, int skip)
+{
+	if(cpu->branch){
+		cpu->branch(cpu, cpu->pc - 1, skip);
+	}
+	if(!skip){
+		return 1;
+	}
+	if(TwoWords(cpu->flash[cpu->pc & (AVR_FLASH_WORDS - 1)])){
+		cpu->pc += 2;
+		return 3;
+	}
+	cpu->pc += 1;
+	return 2;
+}
+
+static void Call(AvrCpu *cpu, unsigned long target)
+{
+	PushPc(cpu, cpu->pc);
+	cpu->pc = target & (AVR_FLASH_WORDS - 1);
+	if(cpu->call){
+		cpu->call(cpu, cpu->pc);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Puts the CPU and the peripherals in their reset state; the
+//                flash is left as it is
+//Parameter: The CPU
+//Returns: Nothing
+void AvrReset(AvrCpu *cpu)
+{
+	memset(cpu->data, 0, sizeof(cpu->data));
+	cpu->data[AVR_SPL] = AVR_RAMEND & 0xFF;
+	cpu->data[AVR_SPH] = AVR_RAMEND >> 8;
+	cpu->data[AVR_UCSR0A] = 0x20;
+	cpu->pc = 0;
+	cpu->cycles = 0;
+	cpu->clock = 0;
+	cpu->sleeping = 0;
+	cpu->hold = 0;
+	cpu->pinc = 0xFF;
+	cpu->temp = 0;
+	cpu->timer_prescale = 0;
+	cpu->tx_done = 0;
+	cpu->tx_full = 0;
+	cpu->spi_done = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one instruction, or takes one interrupt, or sleeps until
+//                the next peripheral event
+//Parameter: The CPU
+//Returns: Cycles that passed; 0 in power-down with nothing to wake it (change
+//         the pins or call AvrIdle), -1 on an unknown opcode (left at cpu->pc)
+int AvrStep(AvrCpu *cpu)
+{
+	unsigned char *d = cpu->data;
+	unsigned short op, op2;
+	unsigned long pc;
+	int vector, cycles = 1;
+	int rd, rr, k, b;
+	unsigned char res, sreg;
+	unsigned int addr;
+	unsigned long long next;
+
+	vector = AvrPending(cpu);
+	if(vector >= 0){
+		cycles = AVR_IRQ_CYCLES + (cpu->sleeping ? AVR_WAKE_CYCLES : 0);
+		cpu->sleeping = 0;
+		Acknowledge(cpu, vector);
+		PushPc(cpu, cpu->pc);
+		d[AVR_SREG] &= ~I_FLAG;
+		cpu->pc = vector * 2;
+		cpu->cycles += cycles;
+		Advance(cpu, cycles);
+		if(cpu->irq){
+			cpu->irq(cpu, vector);
+		}
+		return cycles;
+	}
+	if(cpu->sleeping){
+		next = AvrNextEvent(cpu);
+		if(next == ~0ULL){
+			return 0;
+		}
+		cycles = next - cpu->clock;
+		Advance(cpu, cycles);
+		return cycles;
+	}
+	cpu->hold = 0;
+
+	pc = cpu->pc;
+	op = cpu->flash[pc & (AVR_FLASH_WORDS - 1)];
+	op2 = cpu->flash[(pc + 1) & (AVR_FLASH_WORDS - 1)];
+	cpu->pc = (pc + 1) & (AVR_FLASH_WORDS - 1);
+	rd = (op >> 4) & 0x1F;
+	rr = (op & 0x0F) | ((op >> 5) & 0x10);
+	sreg = d[AVR_SREG];
+
+	switch(op >> 12){
+		case 0x0:
+			switch((op >> 10) & 0x03){
+				case 0x0:
+					if(op == 0x0000){
+						break; // NOP
+					}
+					switch((op >> 8) & 0x03){
+						case 0x1: // MOVW
+							d[((op >> 4) & 0x0F) * 2] = d[(op & 0x0F) * 2];
+							d[((op >> 4) & 0x0F) * 2 + 1] = d[(op & 0x0F) * 2 + 1];
+							break;
+						case 0x2: // MULS
+							Multiply(cpu, (signed char)d[16 + ((op >> 4) & 0x0F)] * (signed char)d[16 + (op & 0x0F)], 0);
+							cycles = 2;
+							break;
+						case 0x3:
+							rd = 16 + ((op >> 4) & 0x07);
+							rr = 16 + (op & 0x07);
+							switch(op & 0x88){
+								case 0x00: Multiply(cpu, (signed char)d[rd] * (long)d[rr], 0); break;  // MULSU
+								case 0x08: Multiply(cpu, (long)d[rd] * d[rr], 1); break;               // FMUL
+								case 0x80: Multiply(cpu, (signed char)d[rd] * (signed char)d[rr], 1); break; // FMULS
+								case 0x88: Multiply(cpu, (signed char)d[rd] * (long)d[rr], 1); break;  // FMULSU
+							}
+							cycles = 2;
+							break;
+						default:
+							goto bad;
+					}
+					break;
+				case 0x1: Sub(cpu, d[rd], d[rr], sreg & C_FLAG, 1); break;              // CPC
+				case 0x2: d[rd] = Sub(cpu, d[rd], d[rr], sreg & C_FLAG, 1); break;      // SBC
+				case 0x3: d[rd] = Add(cpu, d[rd], d[rr], 0); break;                     // ADD
+			}
+			break;
+		case 0x1:
+			switch((op >> 10) & 0x03){
+				case 0x0: cycles = Skip(cpu, d[rd] == d[rr]); break;                    // CPSE
+				case 0x1: Sub(cpu, d[rd], d[rr], 0, 0); break;                          // CP
+				case 0x2: d[rd] = Sub(cpu, d[rd], d[rr], 0, 0); break;                  // SUB
+				case 0x3: d[rd] = Add(cpu, d[rd], d[rr], sreg & C_FLAG); break;         // ADC
+			}
+			break;
+		case 0x2:
+			switch((op >> 10) & 0x03){
+				case 0x0: d[rd] = Logic(cpu, d[rd] & d[rr]); break;                     // AND
+				case 0x1: d[rd] = Logic(cpu, d[rd] ^ d[rr]); break;                     // EOR
+				case 0x2: d[rd] = Logic(cpu, d[rd] | d[rr]); break;                     // OR
+				case 0x3: d[rd] = d[rr]; break;                                         // MOV
+			}
+			break;
+		case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+			rd = 16 + ((op >> 4) & 0x0F);
+			k = ((op >> 4) & 0xF0) | (op & 0x0F);
+			switch(op >> 12){
+				case 0x3: Sub(cpu, d[rd], k, 0, 0); break;                              // CPI
+				case 0x4: d[rd] = Sub(cpu, d[rd], k, sreg & C_FLAG, 1); break;          // SBCI
+				case 0x5: d[rd] = Sub(cpu, d[rd], k, 0, 0); break;                      // SUBI
+				case 0x6: d[rd] = Logic(cpu, d[rd] | k); break;                         // ORI
+				case 0x7: d[rd] = Logic(cpu, d[rd] & k); break;                         // ANDI
+				case 0xE: d[rd] = k; break;                                             // LDI
+			}
+			break;
+		case 0x8: case 0xA:
+			// LDD/STD Rd, Y+q or Z+q (LD/ST Y and Z are q = 0)
+			k = (op & 0x07) | ((op >> 7) & 0x18) | ((op >> 8) & 0x20);
+			addr = Pair(cpu, (op & 0x08) ? 28 : 30) + k;
+			if(op & 0x0200){
+				Write(cpu, addr & 0xFFFF, d[rd]);
+			}
+			else{
+				d[rd] = Read(cpu, addr & 0xFFFF);
+			}
+			cycles = 2;
+			break;
+		case 0x9:
+			switch((op >> 8) & 0x0F){
+				case 0x0: case 0x1: case 0x2: case 0x3:
+					cycles = 2;
+					if(op & 0x0200){
+						// STS, ST and PUSH
+						switch(op & 0x0F){
+							case 0x0: Write(cpu, op2, d[rd]); cpu->pc++; break;
+							case 0x1: addr = Pair(cpu, 30); Write(cpu, addr, d[rd]); SetPair(cpu, 30, addr + 1); break;
+							case 0x2: addr = Pair(cpu, 30) - 1; SetPair(cpu, 30, addr); Write(cpu, addr & 0xFFFF, d[rd]); break;
+							case 0x9: addr = Pair(cpu, 28); Write(cpu, addr, d[rd]); SetPair(cpu, 28, addr + 1); break;
+							case 0xA: addr = Pair(cpu, 28) - 1; SetPair(cpu, 28, addr); Write(cpu, addr & 0xFFFF, d[rd]); break;
+							case 0xC: Write(cpu, Pair(cpu, 26), d[rd]); break;
+							case 0xD: addr = Pair(cpu, 26); Write(cpu, addr, d[rd]); SetPair(cpu, 26, addr + 1); break;
+							case 0xE: addr = Pair(cpu, 26) - 1; SetPair(cpu, 26, addr); Write(cpu, addr & 0xFFFF, d[rd]); break;
+							case 0xF: Push(cpu, d[rd]); break;
+							default: goto bad;
+						}
+					}
+					else{
+						// LDS, LD, LPM, ELPM and POP
+						switch(op & 0x0F){
+							case 0x0: d[rd] = Read(cpu, op2); cpu->pc++; break;
+							case 0x1: addr = Pair(cpu, 30); d[rd] = Read(cpu, addr); SetPair(cpu, 30, addr + 1); break;
+							case 0x2: addr = Pair(cpu, 30) - 1; SetPair(cpu, 30, addr); d[rd] = Read(cpu, addr & 0xFFFF); break;
+							case 0x4: case 0x5: case 0x6: case 0x7:
+								addr = Pair(cpu, 30);
+								b = (op & 0x02) ? d[AVR_RAMPZ] : 0;
+								k = cpu->flash[((unsigned long)b << 15 | addr >> 1) & (AVR_FLASH_WORDS - 1)];
+								d[rd] = (addr & 1) ? k >> 8 : k & 0xFF;
+								if(op & 0x01){
+									// Z+ carries into RAMPZ for ELPM
+									if(++addr > 0xFFFF && (op & 0x02)){
+										d[AVR_RAMPZ]++;
+									}
+									SetPair(cpu, 30, addr);
+								}
+								cycles = 3;
+								break;
+							case 0x9: addr = Pair(cpu, 28); d[rd] = Read(cpu, addr); SetPair(cpu, 28, addr + 1); break;
+							case 0xA: addr = Pair(cpu, 28) - 1; SetPair(cpu, 28, addr); d[rd] = Read(cpu, addr & 0xFFFF); break;
+							case 0xC: d[rd] = Read(cpu, Pair(cpu, 26)); break;
+							case 0xD: addr = Pair(cpu, 26); d[rd] = Read(cpu, addr); SetPair(cpu, 26, addr + 1); break;
+							case 0xE: addr = Pair(cpu, 26) - 1; SetPair(cpu, 26, addr); d[rd] = Read(cpu, addr & 0xFFFF); break;
+							case 0xF: d[rd] = Pop(cpu); break;
+							default: goto bad;
+						}
+					}
+					break;
+				case 0x4: case 0x5:
+					switch(op & 0x0F){
+						case 0x0: // COM
+							d[rd] = ~d[rd];
+							Flags(cpu, S_FLAG | V_FLAG | N_FLAG | Z_FLAG | C_FLAG, Nzs(d[rd], 0, 1) | C_FLAG);
+							break;
+						case 0x1: // NEG
+							res = 0 - d[rd];
+							Flags(cpu, H_FLAG | S_FLAG | V_FLAG | N_FLAG | Z_FLAG | C_FLAG,
+								Nzs(res, res == 0x80, 1) | (((res | d[rd]) & 0x08) ? H_FLAG : 0) | (res ? C_FLAG : 0));
+							d[rd] = res;
+							break;
+						case 0x2: // SWAP
+							d[rd] = (d[rd] << 4) | (d[rd] >> 4);
+							break;
+						case 0x3: // INC
+							res = d[rd] + 1;
+							Flags(cpu, S_FLAG | V_FLAG | N_FLAG | Z_FLAG, Nzs(res, res == 0x80, 1));
+							d[rd] = res;
+							break;
+						case 0x5: d[rd] = Shift(cpu, d[rd], (d[rd] >> 1) | (d[rd] & 0x80)); break;          // ASR
+						case 0x6: d[rd] = Shift(cpu, d[rd], d[rd] >> 1); break;                             // LSR
+						case 0x7: d[rd] = Shift(cpu, d[rd], (d[rd] >> 1) | ((sreg & C_FLAG) << 7)); break;  // ROR
+						case 0xA: // DEC
+							res = d[rd] - 1;
+							Flags(cpu, S_FLAG | V_FLAG | N_FLAG | Z_FLAG, Nzs(res, res == 0x7F, 1));
+							d[rd] = res;
+							break;
+						case 0xC: case 0xD: // JMP
+							cpu->pc = ((unsigned long)(((op >> 3) & 0x3E) | (op & 0x01)) << 16 | op2) & (AVR_FLASH_WORDS - 1);
+							cycles = 3;
+							break;
+						case 0xE: case 0xF: // CALL
+							cpu->pc++;
+							Call(cpu, (unsigned long)(((op >> 3) & 0x3E) | (op & 0x01)) << 16 | op2);
+							cycles = 4;
+							break;
+						case 0x8:
+							if(op & 0x0100){
+								switch(op){
+									case 0x9508: // RET
+										cpu->pc = PopPc(cpu);
+										cycles = 4;
+										if(cpu->ret){
+											cpu->ret(cpu);
+										}
+										break;
+									case 0x9518: // RETI
+										cpu->pc = PopPc(cpu);
+										d[AVR_SREG] |= I_FLAG;
+										cpu->hold = 1;
+										cycles = 4;
+										if(cpu->ret){
+											cpu->ret(cpu);
+										}
+										break;
+									case 0x9588: // SLEEP
+										if(d[AVR_SMCR] & 0x01){
+											cpu->sleeping = 1;
+										}
+										break;
+									case 0x9598: // BREAK
+									case 0x95A8: // WDR
+										break;
+									case 0x95C8: // LPM r0, Z
+									case 0x95D8: // ELPM r0, Z
+										addr = Pair(cpu, 30);
+										b = (op & 0x10) ? d[AVR_RAMPZ] : 0;
+										k = cpu->flash[((unsigned long)b << 15 | addr >> 1) & (AVR_FLASH_WORDS - 1)];
+										d[0] = (addr & 1) ? k >> 8 : k & 0xFF;
+										cycles = 3;
+										break;
+									case 0x95E8: // SPM, the flash stays as it is
+										break;
+									default:
+										goto bad;
+								}
+							}
+							else if(op & 0x0080){
+								d[AVR_SREG] &= ~(1 << ((op >> 4) & 0x07)); // BCLR
+							}
+							else{
+								d[AVR_SREG] |= 1 << ((op >> 4) & 0x07);  // BSET
+								if(((op >> 4) & 0x07) == 7){
+									cpu->hold = 1; // SEI: the next instruction runs first
+								}
+							}
+							break;
+						case 0x9:
+							if(op == 0x9409){ // IJMP
+								cpu->pc = Pair(cpu, 30);
+								cycles = 2;
+							}
+							else if(op == 0x9509){ // ICALL
+								Call(cpu, Pair(cpu, 30));
+								cycles = 3;
+							}
+							else{
+								goto bad;
+							}
+							break;
+						default:
+							goto bad;
+					}
+					break;
+				case 0x6: case 0x7: {
+					// ADIW/SBIW on r24, r26, r28, r30
+					unsigned int before, after;
+
+					rd = 24 + ((op >> 3) & 0x06);
+					k = ((op >> 2) & 0x30) | (op & 0x0F);
+					before = Pair(cpu, rd);
+					after = ((op & 0x0100) ? before - k : before + k) & 0xFFFF;
+					SetPair(cpu, rd, after);
+					if(op & 0x0100){
+						b = (before & 0x8000) && !(after & 0x8000);   // V
+						k = (after & 0x8000) && !(before & 0x8000);   // C
+					}
+					else{
+						b = !(before & 0x8000) && (after & 0x8000);
+						k = (before & 0x8000) && !(after & 0x8000);
+					}
+					Flags(cpu, S_FLAG | V_FLAG | N_FLAG | Z_FLAG | C_FLAG,
+						Nzs(after >> 8, b, after == 0) | (k ? C_FLAG : 0));
+					cycles = 2;
+					break;
+				}
+				case 0x8: case 0x9: case 0xA: case 0xB:
+					// CBI, SBIC, SBI, SBIS on I/O 0-31
+					addr = 0x20 + ((op >> 3) & 0x1F);
+					b = 1 << (op & 0x07);
+					switch((op >> 8) & 0x03){
+						case 0x0: // CBI, a no-op on flags that clear by writing one
+							if(addr != AVR_TIFR1 && addr != AVR_PCIFR){
+								IoWrite(cpu, addr, IoRead(cpu, addr) & ~b);
+							}
+							cycles = 2;
+							break;
+						case 0x1: cycles = Skip(cpu, !(IoRead(cpu, addr) & b)); break;
+						case 0x2: // SBI, clears just that flag on TIFR1/PCIFR
+							IoWrite(cpu, addr, (addr == AVR_TIFR1 || addr == AVR_PCIFR) ? b : IoRead(cpu, addr) | b);
+							cycles = 2;
+							break;
+						case 0x3: cycles = Skip(cpu, (IoRead(cpu, addr) & b) != 0); break;
+					}
+					break;
+				default: // MUL
+					Multiply(cpu, (long)d[rd] * d[rr], 0);
+					cycles = 2;
+					break;
+			}
+			break;
+		case 0xB:
+			addr = 0x20 + ((op & 0x0F) | ((op >> 5) & 0x30));
+			if(op & 0x0800){
+				IoWrite(cpu, addr, d[rd]); // OUT
+				if(addr == AVR_SREG && (d[rd] & I_FLAG) && !(sreg & I_FLAG)){
+					cpu->hold = 1;
+				}
+			}
+			else{
+				d[rd] = IoRead(cpu, addr); // IN
+			}
+			break;
+		case 0xC: case 0xD:
+			// RJMP, RCALL: 12-bit signed word offset
+			k = op & 0x0FFF;
+			if(k & 0x0800){
+				k -= 0x1000;
+			}
+			if(op & 0x1000){
+				Call(cpu, cpu->pc + k);
+				cycles = 3;
+			}
+			else{
+				cpu->pc = (cpu->pc + k) & (AVR_FLASH_WORDS - 1);
+				cycles = 2;
+			}
+			break;
+		case 0xF:
+			b = op & 0x07;
+			switch((op >> 9) & 0x07){
+				case 0x0: case 0x1: case 0x2: case 0x3: {
+					// BRBS/BRBC: 7-bit signed word offset
+					int set = (sreg >> b) & 1;
+					int taken = (op & 0x0400) ? !set : set;
+
+					k = (op >> 3) & 0x7F;
+					if(k & 0x40){
+						k -= 0x80;
+					}
+					if(cpu->branch){
+						cpu->branch(cpu, pc, taken);
+					}
+					if(taken){
+						cpu->pc = (cpu->pc + k) & (AVR_FLASH_WORDS - 1);
+						cycles = 2;
+					}
+					break;
+				}
+				case 0x4: // BLD
+					d[rd] = (sreg & T_FLAG) ? d[rd] | (1 << b) : d[rd] & ~(1 << b);
+					break;
+				case 0x5: // BST
+					Flags(cpu, T_FLAG, (d[rd] >> b) & 1 ? T_FLAG : 0);
+					break;
+				case 0x6: cycles = Skip(cpu, !(d[rd] & (1 << b))); break; // SBRC
+				case 0x7: cycles = Skip(cpu, (d[rd] & (1 << b)) != 0); break; // SBRS
+			}
+			break;
+	}
+	cpu->cycles += cycles;
+	Advance(cpu, cycles);
+	return cycles;
+
+bad:
+	cpu->pc = pc;
+	return -1;
+}
+//--------End Core------------------------------------------------------------
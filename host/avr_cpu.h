@@ -0,0 +1,85 @@
+// Instruction-level ATmega1284 for the host tools: the AVRe+ core with the
+// cycle count of every instruction and interrupt, plus the peripherals main.c
+// uses (Timer1 in CTC mode, USART0 transmit, SPI master, pin-change interrupt 2
+// on PORTC, sleep). Load a flash image, set the buttons, call AvrStep; the
+// hooks let a harness follow calls, returns, branches and interrupts.
+#ifndef HOST_AVR_CPU_H
+#define HOST_AVR_CPU_H
+
+#define AVR_FLASH_WORDS 0x10000UL // 128 KB
+#define AVR_DATA_SIZE 0x4100UL    // Registers, I/O and 16 KB SRAM
+#define AVR_RAMEND (AVR_DATA_SIZE - 1)
+
+// Data space addresses of the registers the core and the peripherals use
+#define AVR_PINC 0x26
+#define AVR_TIFR1 0x36
+#define AVR_PCIFR 0x3B
+#define AVR_SPCR 0x4C
+#define AVR_SPSR 0x4D
+#define AVR_SPDR 0x4E
+#define AVR_SMCR 0x53
+#define AVR_RAMPZ 0x5B
+#define AVR_SPL 0x5D
+#define AVR_SPH 0x5E
+#define AVR_SREG 0x5F
+#define AVR_PCICR 0x68
+#define AVR_PCMSK2 0x6D
+#define AVR_TIMSK1 0x6F
+#define AVR_TCCR1B 0x81
+#define AVR_TCNT1L 0x84
+#define AVR_TCNT1H 0x85
+#define AVR_OCR1AL 0x88
+#define AVR_OCR1AH 0x89
+#define AVR_UCSR0A 0xC0
+#define AVR_UCSR0B 0xC1
+#define AVR_UBRR0L 0xC4
+#define AVR_UBRR0H 0xC5
+#define AVR_UDR0 0xC6
+
+// Interrupt vectors (__vector_N) the peripherals raise
+#define AVR_VECTOR_PCINT2 6
+#define AVR_VECTOR_TIMER1_COMPA 13
+#define AVR_VECTOR_SPI_STC 19
+#define AVR_VECTOR_USART0_UDRE 21
+
+#define AVR_IRQ_CYCLES 4          // Interrupt response, 2-byte PC
+#define AVR_WAKE_CYCLES 4         // Added to it when the interrupt ends a sleep
+
+typedef struct AvrCpu AvrCpu;
+
+struct AvrCpu {
+	unsigned short flash[AVR_FLASH_WORDS];
+	unsigned char data[AVR_DATA_SIZE];
+	unsigned long pc;             // Word address
+	unsigned long long cycles;    // Executed, interrupt responses included
+	unsigned long long clock;     // Since reset, time asleep included
+	int sleeping;                 // SLEEP executed, waiting for an interrupt
+	int hold;                     // One more instruction before an interrupt (after SEI or RETI)
+
+	// Peripheral state
+	unsigned char pinc;           // What the buttons put on PORTC
+	unsigned char temp;           // 16-bit register access latch
+	unsigned long timer_prescale; // Cycles into the current Timer1 count
+	unsigned long long tx_done;   // clock when the USART shift register empties
+	int tx_full;                  // UDR0 holds a byte waiting for the shift register
+	unsigned long long spi_done;  // clock when the SPI transfer ends, 0 if idle
+	void (*tx)(AvrCpu *cpu, unsigned char byte); // A byte starts on TXD, may be NULL
+
+	// Harness hooks, all may be NULL. call: target word address after a CALL,
+	// RCALL or ICALL. irq: vector taken. ret: RET or RETI. branch: a
+	// conditional branch or skip at pc, taken or not.
+	void (*call)(AvrCpu *cpu, unsigned long target);
+	void (*irq)(AvrCpu *cpu, int vector);
+	void (*ret)(AvrCpu *cpu);
+	void (*branch)(AvrCpu *cpu, unsigned long pc, int taken);
+	void *user;
+};
+
+void AvrReset(AvrCpu *cpu);
+int AvrStep(AvrCpu *cpu);
+void AvrPins(AvrCpu *cpu, unsigned char pinc);
+int AvrPending(const AvrCpu *cpu);
+void AvrIdle(AvrCpu *cpu, unsigned long long until);
+unsigned long long AvrNextEvent(const AvrCpu *cpu);
+
+#endif
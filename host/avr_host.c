@@ -0,0 +1,14 @@
+// Storage for the I/O registers declared in host/avr/interrupt.h.
+// Inputs are active low like the pulled-up buttons on PORTC, so PINC idles at 0xFF.
+volatile unsigned char PORTA, PORTB, PORTC, PORTD;
+volatile unsigned char DDRA, DDRB, DDRC, DDRD;
+volatile unsigned char PINA = 0xFF, PINB = 0xFF, PINC = 0xFF, PIND = 0xFF;
+
+volatile unsigned char TCCR1A, TCCR1B, TIMSK1;
+volatile unsigned short OCR1A, TCNT1;
+
+volatile unsigned char UBRR0H, UBRR0L, UCSR0A, UCSR0B, UCSR0C, UDR0;
+volatile unsigned char SPCR, SPSR, SPDR;
+volatile unsigned char PCICR, PCIFR, PCMSK2, SMCR;
+
+volatile unsigned char SREG;
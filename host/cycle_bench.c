@@ -0,0 +1,624 @@
+// Cycle counts of main.c on the ATmega1284: runs an avr-gcc build of main.c
+// instruction by instruction on host/avr_cpu.c, from reset through button
+// scripts, and reports what the tick functions, the interrupts and the
+// scheduler cost in CPU cycles, per state and per path through the code.
+//
+// Build: gcc -O2 -o cycle_bench host/cycle_bench.c host/avr_cpu.c host/elf.c host/script.c
+//
+// Use:   avr-gcc -mmcu=atmega1284 -DF_CPU=8000000UL -Os -o pingpong.elf main.c
+//        ./cycle_bench pingpong.elf host/golden/rally.scn         report
+//        ./cycle_bench -l SMDisplay=300 -l tick=2000 ...           exit 1 past a limit
+//        ./cycle_bench -p 10 ...      list up to 10 paths per state (default 3, 0 for none)
+//        ./cycle_bench -a ...         every function called, not just tasks, ISRs and scheduler
+//        ./cycle_bench -f ...         skip the idle loop (StackScan calls) instead of running it
+//
+// A function's cycles run from its CALL (or the interrupt response) to its
+// RET, callees included and interrupts taken meanwhile left out. A path is
+// the sequence of conditional branches and skips a call went through, its
+// callees' included; calls from one state along one path cost the same unless
+// a loop runs a different number of times. The tick is the time from the
+// Timer1 match to the main loop's first StackScan call (or SLEEP) after
+// SchedulerTick: everything the CPU does for one scheduler period, interrupts
+// included. "limit" names
+// are symbols (SMDisplay, __vector_13 or TIMER1_COMPA_vect) or "tick", and
+// are checked against the slowest call.
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "avr_cpu.h"
+#include "elf.h"
+#include "script.h"
+
+#define F_CPU 8000000UL
+#define MS_CYCLES (F_CPU / 1000)
+#define MAX_DEPTH 64
+#define MAX_LIMITS 16
+#define PATH_SLOTS 65536UL       // Power of two
+
+enum Func_Kinds { Fn_plain, Fn_task, Fn_isr, Fn_sched };
+
+// Tick functions of the tasks, and the loop functions main() calls every tick
+static const char *TaskNames[] = { "SMDisplay", "SMBall", "SMPlayerPaddle", "SMEnemyPaddle" };
+static const char *SchedNames[] = { "SchedulerTick", "PowerTick" };
+static const struct {
+	int vector;
+	const char *name;
+} Vectors[] = {
+	{ AVR_VECTOR_PCINT2, "PCINT2_vect" },
+	{ AVR_VECTOR_TIMER1_COMPA, "TIMER1_COMPA_vect" },
+	{ AVR_VECTOR_SPI_STC, "SPI_STC_vect" },
+	{ AVR_VECTOR_USART0_UDRE, "USART0_UDRE_vect" },
+};
+
+typedef struct {
+	const char *name;          // Symbol, or the vector name for an ISR
+	unsigned long addr;        // Word address
+	int kind;
+	unsigned long calls, min, max;
+	unsigned long long total;
+} Func;
+
+typedef struct {
+	int fn;                    // Index into funcs, -1 for code without a symbol
+	unsigned long long start;  // cpu.cycles at the CALL or interrupt
+	unsigned long long isr;    // Cycles of interrupts taken inside
+	unsigned long hash;        // Branches taken and not taken so far
+	int state;                 // r25:r24 on entry, for tick functions
+	int irq;
+} Frame;
+
+typedef struct {
+	int used, fn, state, next, order;
+	unsigned long hash, calls, min, max;
+	unsigned long long total;
+} Path;
+
+typedef struct {
+	char name[64];
+	unsigned long cycles;
+} Limit;
+
+static AvrCpu cpu;
+static Func *funcs;
+static int func_count;
+static Frame stack[MAX_DEPTH];
+static int depth;
+static Path *paths;
+static unsigned long path_count;
+static unsigned long stack_scan = ~0UL;   // Word address of StackScan
+static unsigned long scheduler = ~0UL;    // Word address of SchedulerTick
+static int fast_idle;
+
+// The tick being measured: 1 from the Timer1 match, 2 once SchedulerTick has been called
+static int tick_open;
+static unsigned long long tick_start;
+static unsigned long tick_count, tick_min = ~0UL, tick_max, overruns;
+static unsigned long long tick_total;
+static const char *tick_max_script;
+static unsigned long tick_max_ms;
+static const char *script_name;
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Finds the function that starts at a word address
+//Parameter: Word address
+//Returns: Index into funcs, -1 if none
+static int FindFunc(unsigned long addr)
+{
+	int lo = 0, hi = func_count - 1, mid;
+
+	while(lo <= hi){
+		mid = (lo + hi) / 2;
+		if(funcs[mid].addr == addr){
+			return mid;
+		}
+		if(funcs[mid].addr < addr){
+			lo = mid + 1;
+		}
+		else{
+			hi = mid - 1;
+		}
+	}
+	return -1;
+}
+
+static int ByAddr(const void *a, const void *b)
+{
+	const Func *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Puts an avr-gcc executable into flash and indexes its functions
+//Parameter: ELF file name
+//Returns: 0, or -1 with a message on stderr
+static int Load(const char *path)
+{
+	Elf e;
+	const ElfSymbol *load;
+	char vector[16];
+	int n, k;
+
+	if(ElfLoad(&e, path)){
+		return -1;
+	}
+	if(e.machine != EM_AVR || e.type != ET_EXEC){
+		fprintf(stderr, "%s: not an AVR executable (link it with avr-gcc -mmcu=atmega1284)\n", path);
+		ElfFree(&e);
+		return -1;
+	}
+	memset(cpu.flash, 0xFF, sizeof(cpu.flash));
+	load = ElfFindSymbol(&e, "__data_load_start");
+	for(n = 0; n < e.section_count; n++){
+		const ElfSection *s = &e.sections[n];
+		unsigned long at = s->addr;
+
+		if(!(s->flags & SHF_ALLOC) || s->type == SHT_NOBITS){
+			continue;
+		}
+		if(at >= 0x800000){
+			// Only .data has start values in flash; the startup code copies them
+			if(strcmp(s->name, ".data") != 0 || !load){
+				continue;
+			}
+			at = load->value;
+		}
+		if(at + s->size > AVR_FLASH_WORDS * 2 || s->offset + s->size > e.size){
+			fprintf(stderr, "%s: %s does not fit the flash\n", path, s->name);
+			ElfFree(&e);
+			return -1;
+		}
+		for(k = 0; k < (int)s->size; k++){
+			unsigned short *w = &cpu.flash[(at + k) / 2];
+			unsigned char byte = e.data[s->offset + k];
+
+			*w = ((at + k) & 1) ? (*w & 0x00FF) | byte << 8 : (*w & 0xFF00) | byte;
+		}
+	}
+
+	funcs = calloc(e.symbol_count, sizeof(Func));
+	for(n = 0; n < e.symbol_count; n++){
+		const ElfSymbol *y = &e.symbols[n];
+
+		if(y->type != STT_FUNC || y->section == 0 || y->value >= 0x800000){
+			continue;
+		}
+		funcs[func_count].name = strdup(y->name);
+		funcs[func_count].addr = y->value / 2;
+		funcs[func_count].min = ~0UL;
+		func_count++;
+	}
+	// Sorted for FindFunc; of two names for one address the first stays
+	qsort(funcs, func_count, sizeof(Func), ByAddr);
+	for(n = k = 0; n < func_count; n++){
+		if(k == 0 || funcs[n].addr != funcs[k - 1].addr){
+			funcs[k++] = funcs[n];
+		}
+	}
+	func_count = k;
+	for(n = 0; n < func_count; n++){
+		for(k = 0; k < (int)(sizeof(TaskNames) / sizeof(TaskNames[0])); k++){
+			if(strcmp(funcs[n].name, TaskNames[k]) == 0){
+				funcs[n].kind = Fn_task;
+			}
+		}
+		for(k = 0; k < (int)(sizeof(SchedNames) / sizeof(SchedNames[0])); k++){
+			if(strcmp(funcs[n].name, SchedNames[k]) == 0){
+				funcs[n].kind = Fn_sched;
+			}
+		}
+		for(k = 0; k < (int)(sizeof(Vectors) / sizeof(Vectors[0])); k++){
+			sprintf(vector, "__vector_%d", Vectors[k].vector);
+			if(strcmp(funcs[n].name, vector) == 0){
+				funcs[n].name = Vectors[k].name;
+				funcs[n].kind = Fn_isr;
+			}
+		}
+		if(strcmp(funcs[n].name, "StackScan") == 0){
+			stack_scan = funcs[n].addr;
+		}
+		if(strcmp(funcs[n].name, "SchedulerTick") == 0){
+			scheduler = funcs[n].addr;
+		}
+	}
+	ElfFree(&e);
+	return 0;
+}
+
+//--------Profiler hooks------------------------------------------------------
+
+static void Push(int fn, unsigned long long start, int irq)
+{
+	Frame *f;
+
+	if(depth == MAX_DEPTH){
+		fprintf(stderr, "calls nested deeper than %d at 0x%05lX\n", MAX_DEPTH, cpu.pc * 2);
+		exit(2);
+	}
+	f = &stack[depth++];
+	f->fn = fn;
+	f->start = start;
+	f->isr = 0;
+	f->hash = 2166136261UL;
+	f->state = (short)(cpu.data[24] | cpu.data[25] << 8);
+	f->irq = irq;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Adds one finished call to its function and path
+//Parameter: The frame, its cycles, state it returned
+//Returns: Nothing
+static void Record(const Frame *f, unsigned long cycles, int next)
+{
+	Func *fn = &funcs[f->fn];
+	unsigned long slot;
+	Path *p;
+
+	fn->calls++;
+	fn->total += cycles;
+	if(cycles < fn->min){ fn->min = cycles; }
+	if(cycles > fn->max){ fn->max = cycles; }
+	if(fn->kind != Fn_task && fn->kind != Fn_isr){
+		return;
+	}
+	if(fn->kind == Fn_isr){
+		next = 0;
+	}
+	slot = (f->hash ^ (unsigned long)f->fn * 40503UL ^ (unsigned long)(f->state & 0xFFFF) * 9973UL) & (PATH_SLOTS - 1);
+	for(p = &paths[slot]; p->used; p = &paths[slot = (slot + 1) & (PATH_SLOTS - 1)]){
+		if(p->fn == f->fn && p->hash == f->hash && p->state == f->state && p->next == next){
+			break;
+		}
+	}
+	if(!p->used){
+		if(path_count == PATH_SLOTS / 2){
+			fprintf(stderr, "more than %lu different paths\n", PATH_SLOTS / 2);
+			exit(2);
+		}
+		p->used = 1;
+		p->fn = f->fn;
+		p->hash = f->hash;
+		p->state = f->state;
+		p->next = next;
+		p->order = path_count++;
+		p->min = ~0UL;
+	}
+	p->calls++;
+	p->total += cycles;
+	if(cycles < p->min){ p->min = cycles; }
+	if(cycles > p->max){ p->max = cycles; }
+}
+
+static void TickEnd(void)
+{
+	unsigned long busy = cpu.cycles - tick_start;
+
+	tick_open = 0;
+	tick_count++;
+	tick_total += busy;
+	if(busy < tick_min){ tick_min = busy; }
+	if(busy > tick_max){
+		tick_max = busy;
+		tick_max_script = script_name;
+		tick_max_ms = cpu.clock / MS_CYCLES;
+	}
+}
+
+static void OnCall(AvrCpu *c, unsigned long target)
+{
+	// A match just before the idle loop's CALL must not end the tick before it ran
+	if(target == scheduler && tick_open){
+		tick_open = 2;
+	}
+	if(target == stack_scan && tick_open == 2){
+		TickEnd();
+	}
+	// Hooks run before the instruction's cycles are added: the CALL counts to the callee
+	Push(FindFunc(target), c->cycles, 0);
+}
+
+static void OnIrq(AvrCpu *c, int vector)
+{
+	unsigned long long start = c->cycles - AVR_IRQ_CYCLES;
+	unsigned short op = c->flash[c->pc];
+
+	if(vector == AVR_VECTOR_TIMER1_COMPA){
+		if(tick_open){
+			overruns++;
+			TickEnd();
+		}
+		tick_open = 1;
+		tick_start = start;
+	}
+	// The frame belongs to the ISR the vector's JMP goes to, the response and the JMP included
+	Push((op & 0xFE0E) == 0x940C ? FindFunc(c->flash[c->pc + 1]) : -1, start, 1);
+	stack[depth - 1].state = 0;
+}
+
+static void OnRet(AvrCpu *c)
+{
+	Frame *f, *up;
+	unsigned long long spent;
+
+	if(depth == 0){
+		return; // A return the profiler did not see the call of
+	}
+	f = &stack[--depth];
+	spent = c->cycles + 4 - f->start; // RET and RETI take 4, added after the hook
+	if(f->fn >= 0){
+		Record(f, spent - f->isr, (short)(c->data[24] | c->data[25] << 8));
+	}
+	if(depth == 0){
+		return;
+	}
+	up = &stack[depth - 1];
+	if(f->irq){
+		up->isr += spent;
+	}
+	else{
+		up->isr += f->isr;
+		up->hash = (up->hash ^ f->hash) * 16777619UL;
+	}
+}
+
+static void OnBranch(AvrCpu *c, unsigned long pc, int taken)
+{
+	(void)c;
+	if(depth > 0){
+		stack[depth - 1].hash = (stack[depth - 1].hash ^ (pc << 1 | taken)) * 16777619UL;
+	}
+}
+//--------End Profiler hooks--------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs the program from reset through one button script
+//Parameter: Script file
+//Returns: 0, or -1 with a message on stderr
+static int Run(const char *path)
+{
+	Script s;
+	unsigned long long ms, last = ~0ULL, next;
+	unsigned int sp;
+	int n;
+
+	if(ScriptLoad(&s, path)){
+		return -1;
+	}
+	script_name = path;
+	AvrReset(&cpu);
+	depth = 0;
+	tick_open = 0;
+	while(cpu.clock < (unsigned long long)s.end * MS_CYCLES){
+		ms = cpu.clock / MS_CYCLES;
+		if(ms != last){
+			AvrPins(&cpu, ~ScriptButtons(&s, ms));
+			last = ms;
+		}
+		if(fast_idle && cpu.pc == stack_scan && AvrPending(&cpu) < 0){
+			// Straight back out of StackScan, then wait for whatever the peripherals do next
+			sp = (cpu.data[AVR_SPL] | cpu.data[AVR_SPH] << 8) + 2;
+			cpu.pc = cpu.data[sp - 1] << 8 | cpu.data[sp];
+			cpu.data[AVR_SPL] = sp & 0xFF;
+			cpu.data[AVR_SPH] = sp >> 8;
+			depth--;
+			next = AvrNextEvent(&cpu);
+			AvrIdle(&cpu, next < (ms + 1) * MS_CYCLES ? next : (ms + 1) * MS_CYCLES);
+			continue;
+		}
+		n = AvrStep(&cpu);
+		if(n < 0){
+			fprintf(stderr, "%s: unknown opcode 0x%04X at 0x%05lX (%llu ms)\n", path, cpu.flash[cpu.pc], cpu.pc * 2, ms);
+			ScriptFree(&s);
+			return -1;
+		}
+		if(n == 0){
+			// Power-down: nothing happens until the buttons change
+			AvrIdle(&cpu, (unsigned long long)(ms + 1) * MS_CYCLES);
+		}
+		if(cpu.sleeping && tick_open == 2){
+			TickEnd();
+		}
+	}
+	ScriptFree(&s);
+	return 0;
+}
+
+static int ByMax(const void *a, const void *b)
+{
+	const Path *x = *(const Path * const *)a, *y = *(const Path * const *)b;
+
+	if(x->state != y->state){
+		return x->state < y->state ? -1 : 1;
+	}
+	if(x->next != y->next){
+		return x->next < y->next ? -1 : 1;
+	}
+	return x->max > y->max ? -1 : x->max < y->max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Prints one task's calls per state and its slowest paths, or an ISR's paths
+//Parameter: Index into funcs, paths to list per state
+//Returns: Nothing
+static void ReportTask(int fn, int show)
+{
+	Path **list = malloc(path_count * sizeof(Path *));
+	unsigned long n, k, count = 0, calls, min, max;
+	unsigned long long total;
+
+	for(n = 0; n < PATH_SLOTS; n++){
+		if(paths[n].used && paths[n].fn == fn){
+			list[count++] = &paths[n];
+		}
+	}
+	qsort(list, count, sizeof(Path *), ByMax);
+	if(funcs[fn].kind == Fn_isr){
+		printf("\n%s by path\n                   calls     min    mean     max\n", funcs[fn].name);
+		for(n = 0; n < count && (long)n < show; n++){
+			printf("     path %-5d %8lu %7lu %7.1f %7lu\n", list[n]->order, list[n]->calls, list[n]->min,
+				(double)list[n]->total / list[n]->calls, list[n]->max);
+		}
+		if(count > (unsigned long)show){
+			printf("     %lu more\n", count - show);
+		}
+		free(list);
+		return;
+	}
+	printf("\n%s by state\n  state -> next     calls     min    mean     max  paths\n", funcs[fn].name);
+	for(n = 0; n < count; n = k){
+		calls = 0;
+		total = 0;
+		min = ~0UL;
+		max = 0;
+		for(k = n; k < count && list[k]->state == list[n]->state && list[k]->next == list[n]->next; k++){
+			calls += list[k]->calls;
+			total += list[k]->total;
+			if(list[k]->min < min){ min = list[k]->min; }
+			if(list[k]->max > max){ max = list[k]->max; }
+		}
+		printf("  %5d -> %-4d %8lu %7lu %7.1f %7lu  %5lu\n", list[n]->state, list[n]->next, calls, min,
+			(double)total / calls, max, k - n);
+		for(calls = n; calls < k && calls < n + show; calls++){
+			printf("     path %-5d %8lu %7lu %7.1f %7lu\n", list[calls]->order, list[calls]->calls, list[calls]->min,
+				(double)list[calls]->total / list[calls]->calls, list[calls]->max);
+		}
+	}
+	free(list);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Prints the tick, the function table and the task tables
+//Parameter: ELF name, scripts run, ms and cycles run, paths to list per state, list every function
+//Returns: Nothing
+static void Report(const char *elf, int scripts, unsigned long long ms, unsigned long long cycles, int show, int all)
+{
+	unsigned long period = (cpu.data[AVR_OCR1AL] | cpu.data[AVR_OCR1AH] << 8) + 1;
+	static const unsigned long prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	int kind, n;
+
+	period *= prescale[cpu.data[AVR_TCCR1B] & 0x07];
+	printf("%s: %d script(s), %llu ms, %.1fM cycles run\n", elf, scripts, ms, cycles / 1e6);
+	printf("\ntick: Timer1 match to idle loop, interrupts included, %lu cycles per period\n", period);
+	if(tick_count){
+		printf("     ticks     min    mean     max  of period  overruns  slowest\n");
+		printf("  %8lu %7lu %7.1f %7lu  %8.1f%%  %8lu  %s at %lu ms\n", tick_count, tick_min,
+			(double)tick_total / tick_count, tick_max, period ? 100.0 * tick_max / period : 0, overruns,
+			tick_max_script, tick_max_ms);
+	}
+	else{
+		printf("  none seen (no StackScan in the build, or the timer never ran)\n");
+	}
+
+	printf("\nfunction                 calls     min    mean     max\n");
+	for(kind = Fn_isr; ; kind = kind == Fn_isr ? Fn_sched : kind == Fn_sched ? Fn_task : Fn_plain){
+		for(n = 0; n < func_count; n++){
+			if(funcs[n].kind == kind && funcs[n].calls && (kind != Fn_plain || all)){
+				printf("%-20s %9lu %7lu %7.1f %7lu\n", funcs[n].name, funcs[n].calls, funcs[n].min,
+					(double)funcs[n].total / funcs[n].calls, funcs[n].max);
+			}
+		}
+		if(kind == Fn_plain){
+			break;
+		}
+	}
+	for(n = 0; n < func_count; n++){
+		if((funcs[n].kind == Fn_task || funcs[n].kind == Fn_isr) && funcs[n].calls){
+			ReportTask(n, show);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Checks the slowest call of every limited function
+//Parameter: Limits, how many
+//Returns: 0 if all are within their limit, 1 otherwise
+static int Check(Limit *limits, int count)
+{
+	unsigned long max;
+	int n, k, failed = 0, found;
+	char vector[16];
+
+	for(n = 0; n < count; n++){
+		found = 0;
+		max = 0;
+		if(strcmp(limits[n].name, "tick") == 0){
+			found = 1;
+			max = tick_max;
+		}
+		for(k = 0; k < (int)(sizeof(Vectors) / sizeof(Vectors[0])); k++){
+			// __vector_13 and TIMER1_COMPA_vect are the same limit
+			sprintf(vector, "__vector_%d", Vectors[k].vector);
+			if(strcmp(vector, limits[n].name) == 0){
+				strcpy(limits[n].name, Vectors[k].name);
+			}
+		}
+		for(k = 0; k < func_count; k++){
+			if(strcmp(funcs[k].name, limits[n].name) == 0){
+				found = 1;
+				max = funcs[k].max;
+			}
+		}
+		if(!found){
+			printf("limit %s: no such function\n", limits[n].name);
+			failed = 1;
+		}
+		else if(max > limits[n].cycles){
+			printf("limit %s: %lu cycles, over the limit of %lu\n", limits[n].name, max, limits[n].cycles);
+			failed = 1;
+		}
+	}
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	Limit limits[MAX_LIMITS];
+	int limit_count = 0, show = 3, all = 0, opt, n;
+	unsigned long long ms = 0, cycles = 0;
+	char *eq;
+
+	while((opt = getopt(argc, argv, "l:p:af")) != -1){
+		switch(opt){
+			case 'l':
+				eq = strchr(optarg, '=');
+				if(!eq || limit_count == MAX_LIMITS || eq - optarg >= (int)sizeof(limits[0].name)){
+					fprintf(stderr, "cycle_bench: -l wants name=cycles\n");
+					return 2;
+				}
+				memcpy(limits[limit_count].name, optarg, eq - optarg);
+				limits[limit_count].name[eq - optarg] = '\0';
+				limits[limit_count].cycles = strtoul(eq + 1, NULL, 0);
+				limit_count++;
+				break;
+			case 'p': show = atoi(optarg); break;
+			case 'a': all = 1; break;
+			case 'f': fast_idle = 1; break;
+			default:
+				fprintf(stderr, "usage: cycle_bench [-l name=cycles]... [-p paths] [-a] [-f] main.elf script.scn...\n");
+				return 2;
+		}
+	}
+	if(argc - optind < 2){
+		fprintf(stderr, "usage: cycle_bench [-l name=cycles]... [-p paths] [-a] [-f] main.elf script.scn...\n");
+		return 2;
+	}
+	if(Load(argv[optind])){
+		return 2;
+	}
+	paths = calloc(PATH_SLOTS, sizeof(Path));
+	cpu.call = OnCall;
+	cpu.irq = OnIrq;
+	cpu.ret = OnRet;
+	cpu.branch = OnBranch;
+	for(n = optind + 1; n < argc; n++){
+		if(Run(argv[n])){
+			return 2;
+		}
+		ms += cpu.clock / MS_CYCLES;
+		cycles += cpu.cycles;
+	}
+	Report(argv[optind], argc - optind - 1, ms, cycles, show, all);
+	return Check(limits, limit_count);
+}
@@ -0,0 +1,144 @@
+// ELF reader, see elf.h.
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elf.h"
+
+static unsigned long Get(const unsigned char *p, int bytes)
+{
+	unsigned long v = 0;
+
+	while(bytes--){
+		v = v << 8 | p[bytes];
+	}
+	return v;
+}
+
+// Field offsets differ between the two classes; W picks the 32- or 64-bit one
+#define W(e, o32, o64) ((e)->is64 ? (o64) : (o32))
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Reads an ELF file and indexes its sections and symbols
+//Parameter: Where to put it, file name
+//Returns: 0, or -1 with a message on stderr
+int ElfLoad(Elf *e, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	const unsigned char *h, *sh, *strtab;
+	unsigned long shoff, shentsize, shstrndx;
+	int n, k;
+
+	memset(e, 0, sizeof(*e));
+	if(!f){
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	e->size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	e->data = malloc(e->size + 1);
+	if(fread(e->data, 1, e->size, f) != e->size){
+		fclose(f);
+		fprintf(stderr, "%s: read failed\n", path);
+		ElfFree(e);
+		return -1;
+	}
+	fclose(f);
+
+	h = e->data;
+	if(e->size < 64 || memcmp(h, ELFMAG, SELFMAG) != 0 || h[EI_DATA] != ELFDATA2LSB){
+		fprintf(stderr, "%s: not a little-endian ELF file\n", path);
+		ElfFree(e);
+		return -1;
+	}
+	e->is64 = h[EI_CLASS] == ELFCLASS64;
+	e->type = Get(h + 16, 2);
+	e->machine = Get(h + 18, 2);
+	e->entry = Get(h + 24, W(e, 4, 8));
+	shoff = Get(h + W(e, 32, 40), W(e, 4, 8));
+	shentsize = Get(h + W(e, 46, 58), 2);
+	e->section_count = Get(h + W(e, 48, 60), 2);
+	shstrndx = Get(h + W(e, 50, 62), 2);
+	if(shoff + e->section_count * shentsize > e->size || shstrndx >= (unsigned long)e->section_count){
+		fprintf(stderr, "%s: bad section table\n", path);
+		ElfFree(e);
+		return -1;
+	}
+
+	e->sections = calloc(e->section_count, sizeof(ElfSection));
+	strtab = h + Get(h + shoff + shstrndx * shentsize + W(e, 16, 24), W(e, 4, 8));
+	for(n = 0; n < e->section_count; n++){
+		ElfSection *s = &e->sections[n];
+		sh = h + shoff + n * shentsize;
+		s->name = (const char *)strtab + Get(sh, 4);
+		s->type = Get(sh + 4, 4);
+		s->flags = Get(sh + 8, W(e, 4, 8));
+		s->addr = Get(sh + W(e, 12, 16), W(e, 4, 8));
+		s->offset = Get(sh + W(e, 16, 24), W(e, 4, 8));
+		s->size = Get(sh + W(e, 20, 32), W(e, 4, 8));
+	}
+
+	// Symbols: the one SHT_SYMTAB section and the string table it links to
+	for(n = 0; n < e->section_count; n++){
+		const ElfSection *s = &e->sections[n];
+		unsigned long entsize = W(e, 16, 24), link;
+
+		if(s->type != SHT_SYMTAB){
+			continue;
+		}
+		link = Get(h + shoff + n * shentsize + W(e, 24, 40), 4);
+		strtab = h + e->sections[link].offset;
+		e->symbol_count = s->size / entsize;
+		e->symbols = calloc(e->symbol_count, sizeof(ElfSymbol));
+		for(k = 0; k < e->symbol_count; k++){
+			const unsigned char *p = h + s->offset + k * entsize;
+			ElfSymbol *y = &e->symbols[k];
+			unsigned char info = p[W(e, 12, 4)];
+
+			y->name = (const char *)strtab + Get(p, 4);
+			y->type = info & 0x0F;
+			y->bind = info >> 4;
+			y->section = Get(p + W(e, 14, 6), 2);
+			y->value = Get(p + W(e, 4, 8), W(e, 4, 8));
+			y->size = Get(p + W(e, 8, 16), W(e, 4, 8));
+			if(y->section >= (unsigned int)e->section_count){
+				y->section = 0; // SHN_ABS, SHN_COMMON and friends
+			}
+		}
+		break;
+	}
+	return 0;
+}
+
+void ElfFree(Elf *e)
+{
+	free(e->data);
+	free(e->sections);
+	free(e->symbols);
+	memset(e, 0, sizeof(*e));
+}
+
+const ElfSection *ElfFindSection(const Elf *e, const char *name)
+{
+	int n;
+
+	for(n = 0; n < e->section_count; n++){
+		if(strcmp(e->sections[n].name, name) == 0){
+			return &e->sections[n];
+		}
+	}
+	return NULL;
+}
+
+const ElfSymbol *ElfFindSymbol(const Elf *e, const char *name)
+{
+	int n;
+
+	for(n = 0; n < e->symbol_count; n++){
+		if(strcmp(e->symbols[n].name, name) == 0){
+			return &e->symbols[n];
+		}
+	}
+	return NULL;
+}
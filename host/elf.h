@@ -0,0 +1,39 @@
+// Minimal ELF reader for the host tools: sections and symbols of a 32- or
+// 64-bit little-endian object or executable, e.g. main.c built by avr-gcc.
+#ifndef HOST_ELF_H
+#define HOST_ELF_H
+
+#include <stddef.h>
+
+typedef struct {
+	const char *name;
+	unsigned long addr, offset, size, flags; // flags: SHF_* of <elf.h>
+	unsigned int type;                       // SHT_*
+} ElfSection;
+
+typedef struct {
+	const char *name;
+	unsigned long value, size;
+	unsigned char type, bind;                // STT_*, STB_*
+	unsigned int section;                    // Index into sections, 0 if undefined or absolute
+} ElfSymbol;
+
+typedef struct {
+	unsigned char *data;                     // The whole file
+	size_t size;
+	int is64;
+	unsigned int machine;                    // EM_*, EM_AVR is 83
+	unsigned int type;                       // ET_REL, ET_EXEC...
+	unsigned long entry;
+	ElfSection *sections;
+	int section_count;
+	ElfSymbol *symbols;
+	int symbol_count;
+} Elf;
+
+int ElfLoad(Elf *e, const char *path);
+void ElfFree(Elf *e);
+const ElfSection *ElfFindSection(const Elf *e, const char *name);
+const ElfSymbol *ElfFindSymbol(const Elf *e, const char *name);
+
+#endif
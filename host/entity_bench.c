@@ -0,0 +1,124 @@
+// Measures what one SMBall tick costs as the entity array fills up: first
+// with more and more balls, then with one ball and more and more obstacles.
+//
+// Build: gcc -O2 -DHOST_BUILD -Ihost -o entity_bench main.c host/avr_host.c
+//            host/sim.c host/state.c host/entity_bench.c
+//
+// Use:   ./entity_bench            about a second per row
+//        ./entity_bench -t 0.2     shorter runs
+//
+// Balls stay on the two middle rows and the layout is put back before every
+// tick, so no ball reaches a paddle row and every timed tick moves all of
+// them; the cost of putting it back is measured on its own and taken off.
+// The times are host nanoseconds: they show how the cost grows with the
+// entity count, not what a tick takes on the AVR.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "avr/interrupt.h"
+#include "game.h"
+#include "sim.h"
+
+#define BALL_MOVING 3   // Ball_Moving in main.c
+
+static double Now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Fills the entity array for one benchmark row
+//Parameter: Number of balls and of obstacles
+//Returns: Nothing
+static void Layout(int balls, int blocks)
+{
+	int n;
+
+	memset(Entities, 0, sizeof(Entities));
+	for(n = 0; n < balls; n++){
+		// One step from the two middle rows is still two rows from a paddle
+		Entities[n].kind = Ent_ball;
+		Entities[n].x = n % BOARD_WIDTH;
+		Entities[n].y = BOARD_HEIGHT / 2 - 1 + (n & 1);
+		Entities[n].left = n & 1;
+		Entities[n].right = !(n & 1);
+		Entities[n].up = (n >> 1) & 1;
+		Entities[n].down = !((n >> 1) & 1);
+	}
+	for(n = balls; n < balls + blocks; n++){
+		Entities[n].kind = Ent_block;
+		Entities[n].x = (n * 3) % BOARD_WIDTH;
+		Entities[n].y = 1 + n % (BOARD_HEIGHT - 2);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Times SMBall in Ball_Moving for the current layout, or only
+//                the layout being put back
+//Parameter: Seconds to run for, 1 to run SMBall
+//Returns: ns per tick in the fastest batch of 1000, the least disturbed by the rest of the machine
+static double Time(double seconds, int run)
+{
+	entity saved[MAX_ENTITIES];
+	double start, batch, best = 1e30;
+	int n;
+
+	memcpy(saved, Entities, sizeof(saved));
+	start = Now();
+	do{
+		batch = Now();
+		for(n = 0; n < 1000; n++){
+			memcpy(Entities, saved, sizeof(saved));
+			__asm__ volatile("" ::: "memory"); // Keep every copy
+			if(run && SMBall(BALL_MOVING) != BALL_MOVING){
+				fprintf(stderr, "entity_bench: a ball scored, the layout reaches a paddle row\n");
+				exit(1);
+			}
+		}
+		batch = Now() - batch;
+		if(batch < best){
+			best = batch;
+		}
+		TlmHead = TlmTail;
+	}while(Now() - start < seconds);
+	return best / 1000 * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = 1, base, ns, reset;
+	int opt, n;
+
+	while((opt = getopt(argc, argv, "t:")) != -1){
+		switch(opt){
+			case 't': seconds = atof(optarg); break;
+			default:
+				fprintf(stderr, "usage: entity_bench [-t seconds]\n");
+				return 2;
+		}
+	}
+	SimInit();
+	PINC = 0xFF;
+
+	Layout(1, 0);
+	reset = Time(seconds, 0);
+	printf("balls blocks  ns/tick  vs 1 ball   (%.1f ns/tick to reset the layout taken off)\n", reset);
+	base = Time(seconds, 1) - reset;
+	printf("%5d %6d %8.1f %8.2fx\n", 1, 0, base, 1.0);
+	for(n = 2; n <= MAX_ENTITIES; n++){
+		Layout(n, 0);
+		ns = Time(seconds, 1) - reset;
+		printf("%5d %6d %8.1f %8.2fx\n", n, 0, ns, ns / base);
+	}
+	for(n = 1; n < MAX_ENTITIES; n++){
+		Layout(1, n);
+		ns = Time(seconds, 1) - reset;
+		printf("%5d %6d %8.1f %8.2fx\n", 1, n, ns, ns / base);
+	}
+	return 0;
+}
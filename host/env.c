@@ -0,0 +1,304 @@
+// Batched PingPong environment, see env.h.
+//
+// Every branch of the tick functions in main.c becomes a lane mask here:
+// comparisons give 0x00/0xFF per game and SEL() picks between the two
+// outcomes, so all games take the same instructions whatever state they are
+// in. The masks follow main.c statement by statement, including the order
+// in which ball_xMove_*/ball_yMove_* are updated within one SMBall tick, and
+// paddle hits use the same row bitboard test as Collide().
+#include <stdlib.h>
+#include <string.h>
+#include "env.h"
+
+typedef unsigned char Vec __attribute__((vector_size(ENV_LANES)));
+
+#define SEL(m, a, b) (((m) & (a)) | (~(m) & (b)))
+#define MASK(c) ((Vec)(c))
+
+// State enum values from main.c
+enum { Ball_init, Ball_start, Ball_idle, Ball_Moving };
+enum { Paddle_init, Paddle_start, Paddle_idle, Paddle_press, Paddle_release };
+
+// Number of per-game byte arrays in Env
+#define ENV_ARRAYS 17
+
+Env *EnvCreate(unsigned long games)
+{
+	Env *env = calloc(1, sizeof(Env));
+	unsigned char *mem;
+
+	env->games = games;
+	env->lanes = (games + ENV_LANES - 1) / ENV_LANES * ENV_LANES;
+	mem = aligned_alloc(ENV_LANES, env->lanes * ENV_ARRAYS);
+	env->x = mem;
+	env->y = env->x + env->lanes;
+	env->player = env->y + env->lanes;
+	env->enemy = env->player + env->lanes;
+	env->left = env->enemy + env->lanes;
+	env->right = env->left + env->lanes;
+	env->up = env->right + env->lanes;
+	env->down = env->up + env->lanes;
+	env->ball_state = env->down + env->lanes;
+	env->player_state = env->ball_state + env->lanes;
+	env->enemy_state = env->player_state + env->lanes;
+	env->player_score = env->enemy_state + env->lanes;
+	env->enemy_score = env->player_score + env->lanes;
+	env->phase = env->enemy_score + env->lanes;
+	env->reward = (signed char *)(env->phase + env->lanes);
+	env->done = (unsigned char *)env->reward + env->lanes;
+	EnvResetAll(env);
+	return env;
+}
+
+void EnvFree(Env *env)
+{
+	if(env){
+		free(env->x);
+		free(env);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Puts one game back to the state main.c has at power-on
+//Parameter: The environment and the game number
+//Returns: Nothing
+void EnvReset(Env *env, unsigned long game)
+{
+	env->x[game] = 0x00;
+	env->y[game] = 0x00;
+	env->player[game] = 0x10;
+	env->enemy[game] = 0x10;
+	env->left[game] = 0x00;
+	env->right[game] = 0x00;
+	env->up[game] = 0xFF;
+	env->down[game] = 0x00;
+	env->ball_state[game] = Ball_init;
+	env->player_state[game] = Paddle_init;
+	env->enemy_state[game] = Paddle_init;
+	env->player_score[game] = 0;
+	env->enemy_score[game] = 0;
+	env->phase[game] = 0;
+	env->reward[game] = 0;
+	env->done[game] = 0;
+}
+
+void EnvResetAll(Env *env)
+{
+	unsigned long n;
+
+	for(n = 0; n < env->lanes; n++){
+		EnvReset(env, n);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Lane version of PaddleRow() and Collide() in main.c
+//Parameter: Paddle centre, ball column, and the lane masks for the ball direction
+//Returns: Masks for a hit and a miss; lanes in neither skimmed the paddle edge
+static inline void Hit(Vec pad, Vec x, Vec left, Vec right, Vec *hit, Vec *miss)
+{
+	Vec onehot = MASK(pad != 0) & MASK((pad & (Vec)(pad - 1)) == 0);
+	Vec row = onehot & (pad | (Vec)(pad << 1) | (Vec)(pad >> 1));
+	Vec skim = (left & (Vec)(pad >> 1)) | (right & (Vec)(pad << 1));
+
+	*miss = MASK((row & x) == 0);
+	*hit = ~*miss & MASK((skim & x) == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Advances every game by one 25 ms step
+//Parameter: The environment, buttons held by each game (BTN_* bits, 1 = pressed)
+//Returns: Nothing, rewards and done flags are left in the environment
+void EnvStep(Env *env, const unsigned char *buttons)
+{
+	unsigned long base;
+
+	for(base = 0; base < env->lanes; base += ENV_LANES){
+		Vec x = *(Vec *)(env->x + base), y = *(Vec *)(env->y + base);
+		Vec p = *(Vec *)(env->player + base), e = *(Vec *)(env->enemy + base);
+		Vec left = *(Vec *)(env->left + base), right = *(Vec *)(env->right + base);
+		Vec up = *(Vec *)(env->up + base), down = *(Vec *)(env->down + base);
+		Vec bs = *(Vec *)(env->ball_state + base);
+		Vec ps = *(Vec *)(env->player_state + base), es = *(Vec *)(env->enemy_state + base);
+		Vec pscore = *(Vec *)(env->player_score + base), escore = *(Vec *)(env->enemy_score + base);
+		Vec phase = *(Vec *)(env->phase + base);
+		Vec btn, tick, restart, start, m, t, hit, miss, scored_p, scored_e, done;
+
+		memcpy(&btn, buttons + base, sizeof(btn));
+		restart = MASK((btn & 0x08) != 0);
+		start = MASK((btn & 0x04) != 0);
+
+		//--------SMBall, due every fourth step------------------------------
+		tick = MASK(phase == 0);
+
+		// Transitions. idle and Ball_Moving both reset the game on restart.
+		m = tick & restart & MASK((bs == Ball_idle) | (bs == Ball_Moving));
+		p = SEL(m, 0x10, p);
+		e = SEL(m, 0x10, e);
+		pscore = SEL(m, 0, pscore);
+		escore = SEL(m, 0, escore);
+
+		m = tick & MASK(bs == Ball_idle);
+		t = m & MASK(p == 0x20);
+		left = SEL(t, 0xFF, left);
+		right = SEL(t, 0x00, right);
+		Vec serve = t;
+		t = m & ~t & MASK(p == 0x04);
+		left = SEL(t, 0x00, left);
+		right = SEL(t, 0xFF, right);
+		serve |= t;
+		t = m & ~serve & start;
+		left = SEL(t, MASK(p == 0x10), left);
+		right = SEL(t, ~MASK(p == 0x10), right);
+		serve |= t;
+
+		Vec moving = tick & MASK(bs == Ball_Moving);
+		bs = SEL(tick & MASK(bs == Ball_start), Ball_idle, bs);
+		bs = SEL(tick & MASK(bs == Ball_init), Ball_start, bs);
+		bs = SEL(serve, Ball_Moving, bs);
+		bs = SEL(moving & restart, Ball_start, bs);
+		moving = serve | (moving & ~restart);
+
+		// Ball_start action
+		m = tick & MASK(bs == Ball_start);
+		y = SEL(m, 0x02, y);
+		x = SEL(m, 0x08, x);
+		left = SEL(m, 0xFF, left);
+		right = SEL(m, 0x00, right);
+		e = SEL(m, 0x10, e);
+		p = SEL(m, 0x10, p);
+
+		// Ball_Moving action: sideways first, bouncing off the side walls
+		m = moving & left;
+		t = m & MASK(x == 0x80);
+		x = SEL(m & ~t, (Vec)(x << 1), x);
+		left = SEL(t, 0x00, left);
+		right = SEL(t, 0xFF, right);
+
+		m = moving & right;
+		t = m & MASK(x == 0x01);
+		x = SEL(m, SEL(t, (Vec)(x << 1), (Vec)(x >> 1)), x);
+		left = SEL(t, 0xFF, left);
+		right = SEL(t, 0x00, right);
+
+		// Up towards the enemy
+		m = moving & up;
+		y = SEL(m & MASK(y != 0x80), (Vec)(y << 1), y);
+		m &= MASK(y == 0x80);
+		Hit(e, x, left, right, &hit, &miss);
+		t = m & hit;
+		y = SEL(t, (Vec)(y >> 1), y);
+		down = SEL(t, 0xFF, down);
+		up = SEL(t, 0x00, up);
+		scored_p = m & miss;
+		bs = SEL(scored_p, Ball_init, bs);
+		pscore -= scored_p;
+		e = SEL(scored_p, 0x10, e);
+		up = SEL(scored_p, 0x00, up);
+		down = SEL(scored_p, 0xFF, down);
+
+		// Down towards the player, also right after an enemy bounce or point
+		m = moving & down;
+		y = SEL(m & MASK(y != 0x01), (Vec)(y >> 1), y);
+		m &= MASK(y == 0x01);
+		Hit(p, x, left, right, &hit, &miss);
+		t = m & hit;
+		y = SEL(t, (Vec)(y << 2), y);
+		down = SEL(t, 0x00, down);
+		up = SEL(t, 0xFF, up);
+		scored_e = m & miss;
+		bs = SEL(scored_e, Ball_init, bs);
+		escore -= scored_e;
+		p = SEL(scored_e, 0x10, p);
+		up = SEL(scored_e, 0xFF, up);
+		down = SEL(scored_e, 0x00, down);
+
+		//--------SMDisplay BallOutput: corner bounce when a paddle edge was skimmed
+		Vec top = tick & up & MASK(y == 0x80);
+		Vec bottom = tick & down & MASK(y == 0x01);
+		Vec f1 = top & left;
+		Vec f2 = top & ~f1 & right;
+		Vec f3 = bottom & right;
+		Vec f4 = bottom & ~f3 & left;
+		y = SEL(f1 | f2, (Vec)(y >> 1), y);
+		y = SEL(f3 | f4, (Vec)(y << 1), y);
+		x = SEL(f1 | f4, (Vec)(x >> 1), x);
+		x = SEL(f2 | f3, (Vec)(x << 1), x);
+		left = SEL(f2 | f3, 0xFF, SEL(f1 | f4, 0x00, left));
+		right = SEL(f1 | f4, 0xFF, SEL(f2 | f3, 0x00, right));
+		up = SEL(f3 | f4, 0xFF, SEL(f1 | f2, 0x00, up));
+		down = SEL(f1 | f2, 0xFF, SEL(f3 | f4, 0x00, down));
+
+		//--------SMPlayerPaddle------------------------------------------------
+		Vec bl = MASK((btn & 0x01) != 0), br = MASK((btn & 0x02) != 0);
+		Vec idle = MASK(ps == Paddle_idle);
+		t = idle & ((bl & MASK(p != 0x40)) | (~bl & br & MASK(p != 0x02)));
+		ps = SEL(MASK(ps == Paddle_release) & ~(bl | br), Paddle_idle, ps);
+		ps = SEL(MASK(ps == Paddle_press), Paddle_release, ps);
+		ps = SEL(t, Paddle_press, ps);
+		ps = SEL(MASK(ps == Paddle_start), Paddle_idle, ps);
+		ps = SEL(MASK(ps == Paddle_init), Paddle_start, ps);
+		p = SEL(t & bl, (Vec)(p << 1), p);
+		p = SEL(t & ~bl, (Vec)(p >> 1), p);
+
+		//--------SMEnemyPaddle: moves right unless the *player* paddle is at 0x20
+		bl = MASK((btn & 0x10) != 0);
+		br = MASK((btn & 0x20) != 0);
+		idle = MASK(es == Paddle_idle);
+		m = idle & ((bl & MASK(e != 0x40)) | (~bl & br & MASK(p != 0x20)));
+		es = SEL(MASK(es == Paddle_release) & ~(bl | br), Paddle_idle, es);
+		es = SEL(MASK(es == Paddle_press), Paddle_release, es);
+		es = SEL(m, Paddle_press, es);
+		es = SEL(MASK(es == Paddle_start), Paddle_idle, es);
+		es = SEL(MASK(es == Paddle_init), Paddle_start, es);
+		e = SEL(m & bl, (Vec)(e << 1), e);
+		e = SEL(m & ~bl & br & MASK(e != 0x02), (Vec)(e >> 1), e);
+
+		phase = (phase + 1) & 0x03;
+
+		//--------Rewards, and power-on for finished games--------------------
+		*(Vec *)(env->reward + base) = (scored_e & 0x01) | (scored_p & 0xFF);
+		done = MASK(pscore == 4) | MASK(escore == 4);
+		*(Vec *)(env->done + base) = done & 0x01;
+
+		*(Vec *)(env->x + base) = SEL(done, 0x00, x);
+		*(Vec *)(env->y + base) = SEL(done, 0x00, y);
+		*(Vec *)(env->player + base) = SEL(done, 0x10, p);
+		*(Vec *)(env->enemy + base) = SEL(done, 0x10, e);
+		*(Vec *)(env->left + base) = SEL(done, 0x00, left);
+		*(Vec *)(env->right + base) = SEL(done, 0x00, right);
+		*(Vec *)(env->up + base) = SEL(done, 0xFF, up);
+		*(Vec *)(env->down + base) = SEL(done, 0x00, down);
+		*(Vec *)(env->ball_state + base) = SEL(done, Ball_init, bs);
+		*(Vec *)(env->player_state + base) = SEL(done, Paddle_init, ps);
+		*(Vec *)(env->enemy_state + base) = SEL(done, Paddle_init, es);
+		*(Vec *)(env->player_score + base) = SEL(done, 0, pscore);
+		*(Vec *)(env->enemy_score + base) = SEL(done, 0, escore);
+		*(Vec *)(env->phase + base) = SEL(done, 0, phase);
+	}
+}
+
+static unsigned char Index(unsigned char pos)
+{
+	return pos ? __builtin_ctz(pos) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Writes what the agent sees of every game
+//Parameter: The environment, ENV_OBS bytes per game (laid out as enum Env_Obs)
+//Returns: Nothing
+void EnvObserve(const Env *env, unsigned char *obs)
+{
+	unsigned long n;
+
+	for(n = 0; n < env->games; n++, obs += ENV_OBS){
+		obs[Obs_ball_x] = Index(env->x[n]);
+		obs[Obs_ball_y] = Index(env->y[n]);
+		obs[Obs_ball_dir] = (env->left[n] & 0x01) | (env->right[n] & 0x02) | (env->up[n] & 0x04) | (env->down[n] & 0x08);
+		obs[Obs_player] = Index(env->player[n]);
+		obs[Obs_enemy] = Index(env->enemy[n]);
+		obs[Obs_player_score] = env->player_score[n];
+		obs[Obs_enemy_score] = env->enemy_score[n];
+		obs[Obs_phase] = env->phase[n];
+	}
+}
@@ -0,0 +1,48 @@
+// Batched PingPong environment for training an enemy AI on the host.
+// Steps many independent games in lockstep, one SIMD lane per game, with the
+// SMBall, SMPlayerPaddle and SMEnemyPaddle rules of main.c re-implemented
+// bit-exact on a struct of arrays (host/env_bench.c -c checks this against
+// the real main.c).
+//
+// One step is one 25 ms paddle period with the buttons held throughout; the
+// ball moves on every fourth step. Games start at power-on, so somebody has
+// to press BTN_START (or move the player paddle onto a trigger column) to
+// serve. A game ends when either score reaches 4; it is reset to power-on in
+// the same step and done is set for it. The Autonomous toggle and AI are not
+// part of the environment: the agent is the AI.
+#ifndef HOST_ENV_H
+#define HOST_ENV_H
+
+#define ENV_LANES 32   // Games per vector; the game count is rounded up to this
+#define ENV_OBS 8      // Bytes per game written by EnvObserve
+
+// Observation layout, one byte each
+enum Env_Obs { Obs_ball_x, Obs_ball_y, Obs_ball_dir, Obs_player, Obs_enemy, Obs_player_score,
+	Obs_enemy_score, Obs_phase };
+
+typedef struct {
+	unsigned long games;       // Games asked for
+	unsigned long lanes;       // Games allocated, a multiple of ENV_LANES
+
+	// Game state, one byte per game. Directions are 0x00/0xFF masks.
+	// Positions are one-hot bytes here (main.c keeps column/row numbers), so only the 8x8 board
+	unsigned char *x, *y;                // BallXPosition, BallYPosition
+	unsigned char *player, *enemy;       // PlayerPaddlePosition, EnemyPaddlePosition
+	unsigned char *left, *right, *up, *down;
+	unsigned char *ball_state, *player_state, *enemy_state; // Values of the main.c state enums
+	unsigned char *player_score, *enemy_score;
+	unsigned char *phase;                // Step within SMBall's 100 ms period, it runs on 0
+
+	// Results of the last EnvStep
+	signed char *reward;   // +1 enemy scored, -1 player scored, 0 otherwise
+	unsigned char *done;   // 1 if the game ended and was reset
+} Env;
+
+Env *EnvCreate(unsigned long games);
+void EnvFree(Env *env);
+void EnvReset(Env *env, unsigned long game);
+void EnvResetAll(Env *env);
+void EnvStep(Env *env, const unsigned char *buttons); // One byte per game, BTN_* bits of sim.h
+void EnvObserve(const Env *env, unsigned char *obs);
+
+#endif
@@ -0,0 +1,215 @@
+// Checks the batched environment (host/env.c) against main.c and measures
+// how fast it steps.
+//
+// Build: gcc -O3 -march=native -DHOST_BUILD -Ihost -o env_bench main.c host/avr_host.c
+//            host/sim.c host/state.c host/env.c host/env_bench.c
+//
+// Use:   ./env_bench -c 2000          play 2000 random games on both, compare every step
+//        ./env_bench -n 65536 -t 5    step 65536 games for 5 s and report steps per second
+//        ./env_bench -j 8 ...         run 8 benchmark processes side by side
+//
+// The check drives main.c through the real scheduler, 25 ms per step, and
+// stops a game when a score reaches 4 (the environment resets there, main.c
+// goes into its win sequence).
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "env.h"
+#include "game.h"
+#include "sim.h"
+
+#define STEP_MS 25
+#define MAX_STEPS 20000   // Per checked game; a point takes a few dozen steps
+#define BUTTON_SETS 64    // Different button arrays cycled through by the benchmark
+
+static uint64_t rng;
+
+static uint32_t Random(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (uint32_t)(rng >> 16);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Picks buttons for one side: nothing, a direction, or chase the ball
+//Parameter: How the side plays (0-3), its paddle, the ball column, its left/right bits
+//Returns: Buttons to hold
+static unsigned char Side(int how, unsigned char paddle, unsigned char ball, unsigned char left, unsigned char right)
+{
+	switch(how){
+		case 1: return left;
+		case 2: return right;
+		case 3: return paddle < ball ? left : paddle > ball ? right : 0;
+	}
+	return 0;
+}
+
+static int Compare(const Env *env, unsigned long game, unsigned long step)
+{
+	struct {
+		const char *name;
+		unsigned char env, avr;
+	} f[] = {
+		// The environment keeps positions one-hot, main.c as column/row numbers
+		{ "BallXPosition", env->x[0], COLUMN(BallXPosition) },
+		{ "BallYPosition", env->y[0], ROW(BallYPosition) },
+		{ "PlayerPaddlePosition", env->player[0], COLUMN(PlayerPaddlePosition) },
+		{ "EnemyPaddlePosition", env->enemy[0], COLUMN(EnemyPaddlePosition) },
+		{ "ball_xMove_left", env->left[0] & 1, ball_xMove_left },
+		{ "ball_xMove_right", env->right[0] & 1, ball_xMove_right },
+		{ "ball_yMove_up", env->up[0] & 1, ball_yMove_up },
+		{ "ball_yMove_down", env->down[0] & 1, ball_yMove_down },
+		{ "PlayerScore", env->player_score[0], PlayerScore },
+		{ "EnemyScore", env->enemy_score[0], EnemyScore },
+		{ "SMBall state", env->ball_state[0], tasks[1]->state },
+		{ "SMPlayerPaddle state", env->player_state[0], tasks[2]->state },
+		{ "SMEnemyPaddle state", env->enemy_state[0], tasks[3]->state },
+	};
+	int n;
+
+	for(n = 0; n < (int)(sizeof(f) / sizeof(f[0])); n++){
+		if(f[n].env != f[n].avr){
+			printf("game %lu step %lu (%lu ms): %s is 0x%02X, main.c has 0x%02X\n", game, step, step * STEP_MS,
+				f[n].name, f[n].env, f[n].avr);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Plays random games on the environment and on main.c side by side
+//Parameter: Number of games, random seed
+//Returns: 0 if every step matched, 1 otherwise
+static int Check(unsigned long games, uint64_t seed)
+{
+	Env *env = EnvCreate(1);
+	unsigned char buttons[ENV_LANES] = { 0 };
+	unsigned long game, step, steps = 0, points = 0, wins = 0;
+	int player = 0, enemy = 0, ms;
+
+	rng = seed;
+	for(game = 0; game < games; game++){
+		EnvResetAll(env);
+		SimInit();
+		for(step = 0; step < MAX_STEPS; step++){
+			// Change what each side does now and then, hold it in between
+			if(Random() % 8 == 0){
+				player = Random() % 4;
+				enemy = Random() % 4;
+			}
+			buttons[0] = Side(player, PlayerPaddlePosition, BallXPosition, BTN_LEFT, BTN_RIGHT)
+				| Side(enemy, EnemyPaddlePosition, BallXPosition, BTN_E_LEFT, BTN_E_RIGHT)
+				| (Random() % 4 == 0 ? BTN_START : 0)
+				| (Random() % 2000 == 0 ? BTN_RESTART : 0);
+
+			EnvStep(env, buttons);
+			for(ms = 0; ms < STEP_MS; ms++){
+				SimStep(buttons[0]);
+			}
+			steps++;
+			points += env->reward[0] != 0;
+			if(env->done[0]){
+				if(PlayerScore != 4 && EnemyScore != 4){
+					printf("game %lu step %lu: environment ended the game at %d:%d\n", game, step, PlayerScore, EnemyScore);
+					return 1;
+				}
+				wins++;
+				break;
+			}
+			if(Compare(env, game, step)){
+				return 1;
+			}
+		}
+	}
+	printf("%lu games, %lu steps, %lu points, %lu won: all match main.c\n", games, steps, points, wins);
+	EnvFree(env);
+	return 0;
+}
+
+static double Now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Steps a batch of games with random buttons for a while
+//Parameter: Number of games, seconds to run, random seed
+//Returns: Game steps done
+static unsigned long Bench(unsigned long games, double seconds, uint64_t seed)
+{
+	Env *env = EnvCreate(games);
+	unsigned char *buttons = malloc(env->lanes * BUTTON_SETS);
+	unsigned long n, steps = 0;
+	double start;
+
+	// Mostly start and paddle buttons, so the games are actually played
+	rng = seed;
+	for(n = 0; n < env->lanes * BUTTON_SETS; n++){
+		buttons[n] = Random() & (BTN_LEFT | BTN_RIGHT | BTN_START | BTN_E_LEFT | BTN_E_RIGHT);
+	}
+	start = Now();
+	do{
+		for(n = 0; n < 256; n++){
+			EnvStep(env, buttons + (steps / games + n) % BUTTON_SETS * env->lanes);
+		}
+		steps += 256 * games;
+	}while(Now() - start < seconds);
+	EnvFree(env);
+	free(buttons);
+	return steps;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long games = 65536, check = 0, *steps;
+	double seconds = 3, start;
+	uint64_t seed = 1;
+	int jobs = 1, opt, n;
+
+	while((opt = getopt(argc, argv, "c:n:t:j:s:")) != -1){
+		switch(opt){
+			case 'c': check = strtoul(optarg, NULL, 0); break;
+			case 'n': games = strtoul(optarg, NULL, 0); break;
+			case 't': seconds = atof(optarg); break;
+			case 'j': jobs = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			default:
+				fprintf(stderr, "usage: env_bench [-c games] [-n games] [-t seconds] [-j jobs] [-s seed]\n");
+				return 2;
+		}
+	}
+	if(check){
+		return Check(check, seed);
+	}
+
+	steps = mmap(NULL, jobs * sizeof(unsigned long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	start = Now();
+	fflush(stdout);
+	for(n = 0; n < jobs; n++){
+		if(fork() == 0){
+			steps[n] = Bench(games, seconds, seed + n);
+			_exit(0);
+		}
+	}
+	for(n = 0; n < jobs; n++){
+		wait(NULL);
+	}
+	start = Now() - start;
+	for(n = 1; n < jobs; n++){
+		steps[0] += steps[n];
+	}
+	printf("%d x %lu games: %.1fM steps/s (%.1f s of game time per second)\n", jobs, games,
+		steps[0] / start / 1e6, steps[0] / start * STEP_MS / 1000);
+	return 0;
+}
@@ -0,0 +1,388 @@
+// Exhaustive state-space exploration of the game logic: SMBall, both paddle
+// state machines and the variables they share. Starting from power-on it tries
+// every distinct button combination for every 25 ms paddle period, breadth
+// first, until no new state turns up. It then reports
+//	- task states that can never be entered (e.g. Ball_Bounce),
+//	- deadlocks: states that every input leaves unchanged,
+//	- invariant violations (host/invariants.c), each with the shortest button
+//	  script that gets there, ready for pingpong_sim -s.
+//
+// Build: gcc -O2 -DHOST_BUILD -Ihost -o explore main.c host/avr_host.c host/sim.c
+//            host/state.c host/script.c host/invariants.c host/explore.c
+//
+// Use:   ./explore
+//        ./explore -k ball_dir -j 8 -o traces
+//
+// The real tick functions run underneath, in scheduler order: SMBall on every
+// fourth step, then SMPlayerPaddle and SMEnemyPaddle. SMDisplay is only run for
+// its BallOutput action, the edge bounce that follows each ball move. The rest
+// of it is left out, which keeps the state space finite and small:
+//	- scores are cleared after every step, so a point shows up as a reset but
+//	  the win sequence (and its counter i) is never entered,
+//	- the Autonomous AI does not move the enemy paddle; the toggle itself and
+//	  the Autonomous flag are explored.
+// Both are covered by the golden suite and the fuzzer instead.
+//
+// A state is the three task states, where SMBall is in its 100 ms period, the
+// ball, paddles, directions and Autonomous, bit-packed into 64 bits and kept
+// in an open-addressing hash set.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "avr/interrupt.h"
+#include "game.h"
+#include "invariants.h"
+#include "script.h"
+#include "sim.h"
+
+#define STEP_MS 25            // Paddle period; buttons are held for a whole step
+#define BALL_STEPS 4          // SMBall runs every fourth step
+#define DISP_BEFORE_BALL 3    // PlayerOutput in main.c: SMDisplay goes to BallOutput next
+#define PARALLEL_MIN 4096     // Smaller frontiers are not worth forking for
+#define NO_VIOLATION 0xFF
+#define PHASE_MASK ((Key)0x03 << 45)
+
+typedef uint64_t Key;
+
+typedef struct {
+	Key key;
+	unsigned char violation;  // Invariant broken on the way into this state, or NO_VIOLATION
+	unsigned char self_loop;  // Input left the state unchanged
+} Successor;
+
+// Visited set: states are numbered in discovery order, the table maps keys to numbers
+static Key *keys;
+static uint32_t *parent;
+static unsigned char *via;     // Buttons that led from parent to this state
+static uint32_t state_count, state_cap;
+static uint32_t *table;
+static uint32_t table_mask;
+
+static unsigned char inputs[128];
+static int input_count;
+
+// Which enum values each task has been seen in, shared with the workers
+static unsigned char *seen;
+
+//--------Packing-------------------------------------------------------------
+static Key Pack(unsigned char phase)
+{
+	return (Key)BallXPosition
+		| (Key)BallYPosition << 8
+		| (Key)PlayerPaddlePosition << 16
+		| (Key)EnemyPaddlePosition << 24
+		| (Key)(ball_xMove_left & 1) << 32
+		| (Key)(ball_xMove_right & 1) << 33
+		| (Key)(ball_yMove_up & 1) << 34
+		| (Key)(ball_yMove_down & 1) << 35
+		| (Key)(tasks[1]->state & 0x07) << 36
+		| (Key)(tasks[2]->state & 0x07) << 39
+		| (Key)(tasks[3]->state & 0x07) << 42
+		| (Key)(phase & 0x03) << 45
+		| (Key)(Autonomous & 1) << 47;
+}
+
+// Puts a packed state back into main.c, returns the step within SMBall's period
+static unsigned char Unpack(Key k)
+{
+	BallXPosition = k;
+	BallYPosition = k >> 8;
+	PlayerPaddlePosition = k >> 16;
+	EnemyPaddlePosition = k >> 24;
+	ball_xMove_left = (k >> 32) & 1;
+	ball_xMove_right = (k >> 33) & 1;
+	ball_yMove_up = (k >> 34) & 1;
+	ball_yMove_down = (k >> 35) & 1;
+	tasks[1]->state = (k >> 36) & 0x07;
+	tasks[2]->state = (k >> 39) & 0x07;
+	tasks[3]->state = (k >> 42) & 0x07;
+	Autonomous = (k >> 47) & 1;
+	PlayerScore = 0;
+	EnemyScore = 0;
+	i = 0;
+	return (k >> 45) & 0x03;
+}
+//--------End Packing---------------------------------------------------------
+
+//--------Visited set---------------------------------------------------------
+static uint32_t Hash(Key k)
+{
+	uint64_t h = k * 0x9E3779B97F4A7C15ULL;
+	return (uint32_t)(h ^ (h >> 29));
+}
+
+static void Grow(void)
+{
+	uint32_t n, slot;
+
+	table_mask = table_mask ? table_mask * 2 + 1 : (1 << 16) - 1;
+	free(table);
+	table = malloc((table_mask + 1) * sizeof(uint32_t));
+	memset(table, 0xFF, (table_mask + 1) * sizeof(uint32_t));
+	for(n = 0; n < state_count; n++){
+		slot = Hash(keys[n]) & table_mask;
+		while(table[slot] != UINT32_MAX){
+			slot = (slot + 1) & table_mask;
+		}
+		table[slot] = n;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Adds a state to the visited set
+//Parameter: The state, the state it was reached from and the buttons used
+//Returns: 1 if the state is new, 0 if it was already visited
+static int Visit(Key k, uint32_t from, unsigned char buttons)
+{
+	uint32_t slot;
+
+	if(state_count * 2 >= table_mask){
+		Grow();
+	}
+	for(slot = Hash(k) & table_mask; table[slot] != UINT32_MAX; slot = (slot + 1) & table_mask){
+		if(keys[table[slot]] == k){
+			return 0;
+		}
+	}
+	if(state_count == state_cap){
+		state_cap = state_cap ? state_cap * 2 : 1 << 16;
+		keys = realloc(keys, state_cap * sizeof(Key));
+		parent = realloc(parent, state_cap * sizeof(uint32_t));
+		via = realloc(via, state_cap);
+	}
+	table[slot] = state_count;
+	keys[state_count] = k;
+	parent[state_count] = from;
+	via[state_count] = buttons;
+	state_count++;
+	return 1;
+}
+//--------End Visited set-----------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one 25 ms step of the game logic with the buttons held
+//Parameter: Buttons in PINC bit order (1 = pressed), step within SMBall's period
+//Returns: Nothing
+static void Step(unsigned char buttons, unsigned char phase)
+{
+	PINC = ~buttons;
+	if(phase == 0){
+		tasks[1]->state = tasks[1]->TickFct(tasks[1]->state);
+	}
+	tasks[2]->state = tasks[2]->TickFct(tasks[2]->state);
+	tasks[3]->state = tasks[3]->TickFct(tasks[3]->state);
+	if(phase == 0){
+		tasks[0]->TickFct(DISP_BEFORE_BALL);
+	}
+	TlmHead = TlmTail; // Nobody drains the telemetry buffer here
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Works out every successor of a range of frontier states
+//Parameter: Frontier state numbers, range to expand, output (input_count per state)
+//Returns: Nothing
+static void Expand(const uint32_t *frontier, uint32_t first, uint32_t last, Successor *out)
+{
+	const Invariant *bad;
+	uint32_t f;
+	int in, t;
+
+	for(f = first; f < last; f++){
+		Key from = keys[frontier[f]];
+		for(in = 0; in < input_count; in++){
+			Successor *s = &out[(size_t)f * input_count + in];
+			unsigned char phase = Unpack(from);
+
+			Step(inputs[in], phase);
+			for(t = 1; t < 4; t++){
+				seen[t * 8 + (tasks[t]->state & 7)] = 1;
+			}
+			bad = InvariantCheck();
+			s->violation = bad ? bad - Invariants : NO_VIOLATION;
+			s->key = Pack((phase + 1) % BALL_STEPS);
+			s->self_loop = (s->key & ~PHASE_MASK) == (from & ~PHASE_MASK);
+		}
+	}
+}
+
+static void WriteTrace(uint32_t state, unsigned char last_buttons, const char *dir, const char *name, const char *why)
+{
+	uint32_t path[4096];
+	int depth = 0, n;
+	char file[4096];
+	Script s;
+	FILE *out;
+
+	for(; state != 0 && depth < 4095; state = parent[state]){
+		path[depth++] = state;
+	}
+	memset(&s, 0, sizeof(s));
+	for(n = depth - 1; n >= 0; n--){
+		ScriptAdd(&s, (depth - 1 - n) * STEP_MS, via[path[n]]);
+	}
+	ScriptAdd(&s, depth * STEP_MS, last_buttons);
+	s.end = (depth + 1) * STEP_MS;
+
+	mkdir(dir, 0777);
+	snprintf(file, sizeof(file), "%s/%s.scn", dir, name);
+	if((out = fopen(file, "w"))){
+		fprintf(out, "# %s\n", why);
+		ScriptWrite(&s, out);
+		fclose(out);
+		printf("    trace: %s (%lu ms)\n", file, s.end);
+	}
+	ScriptFree(&s);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *task_names[] = { "SMDisplay", "SMBall", "SMPlayerPaddle", "SMEnemyPaddle" };
+	static const char *state_names[4][8] = {
+		{ "Disp_init", "Disp_start", "Disp_startSequence", "PlayerOutput", "BallOutput", "EnemyOutput", "PWinState", "EnemyWinState" },
+		{ "Ball_init", "Ball_start", "idle", "Ball_Moving", "Ball_Bounce" },
+		{ "Paddle_init", "Paddle_start", "Paddle_idle", "Paddle_press", "Paddle_release", "auto_function_press", "auto_function_release" },
+		{ "EnemyPaddle_init", "EnemyPaddle_start", "EnemyPaddle_idle", "EnemyPaddle_press", "EnemyPaddle_release" },
+	};
+	static const unsigned char state_total[4] = { NUM_DISPLAY_STATES, NUM_BALL_STATES, NUM_PLAYER_STATES, NUM_ENEMY_STATES };
+	const char *dir = "traces";
+	int verbose = 0, jobs = 1, opt, n, t, level = 0, problems = 0;
+	uint32_t *frontier = NULL, *next = NULL, frontier_count, next_count, f, first_deadlock = UINT32_MAX;
+	uint32_t deadlocks = 0, violations[32] = { 0 }, violation_state[32];
+	unsigned char violation_input[32];
+	struct timespec t0, t1;
+
+	while((opt = getopt(argc, argv, "j:k:o:v")) != -1){
+		switch(opt){
+			case 'j': jobs = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+			case 'k':
+				if(InvariantSkip(optarg) < 0){
+					fprintf(stderr, "explore: unknown invariant in \"%s\"\n", optarg);
+					return 2;
+				}
+			break;
+			case 'o': dir = optarg; break;
+			case 'v': verbose = 1; break;
+			default:
+				fprintf(stderr, "usage: explore [-j jobs] [-k skip,...] [-o dir] [-v]\n");
+				return 2;
+		}
+	}
+	// Both directions at once act like the first one checked, so leave them out
+	for(n = 0; n < 128; n++){
+		if((n & (BTN_LEFT | BTN_RIGHT)) != (BTN_LEFT | BTN_RIGHT)
+				&& (n & (BTN_E_LEFT | BTN_E_RIGHT)) != (BTN_E_LEFT | BTN_E_RIGHT)){
+			inputs[input_count++] = n;
+		}
+	}
+	seen = mmap(NULL, 32, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	SimInit();
+	for(t = 1; t < 4; t++){
+		seen[t * 8 + (tasks[t]->state & 7)] = 1;
+	}
+	Visit(Pack(0), 0, 0);
+	frontier = malloc(sizeof(uint32_t));
+	frontier[0] = 0;
+	frontier_count = 1;
+
+	while(frontier_count){
+		size_t bytes = (size_t)frontier_count * input_count * sizeof(Successor);
+		Successor *succ = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+		// Workers get a slice of the frontier each and write into shared memory;
+		// the visited set is only ever touched here in the parent
+		if(jobs > 1 && frontier_count >= PARALLEL_MIN){
+			fflush(stdout);
+			for(n = 0; n < jobs; n++){
+				if(fork() == 0){
+					Expand(frontier, (uint64_t)frontier_count * n / jobs, (uint64_t)frontier_count * (n + 1) / jobs, succ);
+					_exit(0);
+				}
+			}
+			for(n = 0; n < jobs; n++){
+				wait(NULL);
+			}
+		}
+		else{
+			Expand(frontier, 0, frontier_count, succ);
+		}
+
+		next = malloc(bytes / sizeof(Successor) * sizeof(uint32_t));
+		next_count = 0;
+		for(f = 0; f < frontier_count; f++){
+			int stuck = 1;
+			for(n = 0; n < input_count; n++){
+				Successor *s = &succ[(size_t)f * input_count + n];
+				if(!s->self_loop){
+					stuck = 0;
+				}
+				if(s->violation != NO_VIOLATION){
+					// Broken states are reported but not explored any further
+					if(!violations[s->violation]++){
+						violation_state[s->violation] = frontier[f];
+						violation_input[s->violation] = inputs[n];
+					}
+					continue;
+				}
+				if(Visit(s->key, frontier[f], inputs[n])){
+					next[next_count++] = state_count - 1;
+				}
+			}
+			if(stuck){
+				if(!deadlocks++){
+					first_deadlock = frontier[f];
+				}
+			}
+		}
+		munmap(succ, bytes);
+		if(verbose){
+			printf("level %d: %u new, %u total\n", level, next_count, state_count);
+			fflush(stdout);
+		}
+		free(frontier);
+		frontier = next;
+		frontier_count = next_count;
+		level++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%u reachable states, %d levels of %d ms, %d inputs per state, %.2f s\n", state_count, level, STEP_MS,
+		input_count, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+
+	printf("\nUnreachable task states:\n");
+	for(t = 1; t < 4; t++){
+		for(n = 0; n < state_total[t]; n++){
+			if(!seen[t * 8 + n]){
+				printf("    %s: %s\n", task_names[t], state_names[t][n]);
+			}
+		}
+	}
+
+	printf("\nDeadlocks: %u\n", deadlocks);
+	if(deadlocks){
+		WriteTrace(first_deadlock, 0, dir, "deadlock", "Reaches a state that no button combination gets out of");
+		problems++;
+	}
+
+	printf("\nInvariant violations:\n");
+	for(n = 0; n < InvariantCount; n++){
+		if(violations[n]){
+			char why[256];
+			printf("    %s (%s): %u transition(s)\n", Invariants[n].name, Invariants[n].description, violations[n]);
+			snprintf(why, sizeof(why), "Breaks invariant %s: %s", Invariants[n].name, Invariants[n].description);
+			WriteTrace(violation_state[n], violation_input[n], dir, Invariants[n].name, why);
+			problems++;
+		}
+	}
+	if(!problems){
+		printf("    none\n");
+	}
+	return problems ? 1 : 0;
+}
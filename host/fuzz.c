@@ -0,0 +1,420 @@
+// Fuzzer for the four game state machines. An input is a sequence of PINC
+// samples: each byte is the pressed buttons in PINC order, mode button (bit 7)
+// included, held for 25 ms (one paddle period); a longer hold is the same
+// byte repeated. The invariants in host/invariants.c are checked after every
+// 1 ms tick, so the multi-ball and obstacle layouts the mode button picks are
+// checked as well as the classic game.
+//
+// libFuzzer (coverage from the compiler):
+//   clang -O2 -g -fsanitize=fuzzer,address -DHOST_BUILD -DLIBFUZZER -Ihost -o fuzz main.c
+//         host/avr_host.c host/sim.c host/state.c host/script.c host/invariants.c host/fuzz.c
+//   ./fuzz -jobs=8 -workers=8 corpus/ ; ./fuzz -minimize_crash=1 -runs=20000 crash-...
+//   PP_FUZZ_SKIP=enemy_paddle ./fuzz corpus/      keep going past a known bug
+//
+// Standalone (gcc, game-state coverage instead of compiler coverage):
+//   gcc -O2 -DHOST_BUILD -Ihost -o fuzz main.c host/avr_host.c host/sim.c host/state.c
+//       host/script.c host/invariants.c host/fuzz.c
+//   ./fuzz -j 8 -n 1000000 -o crashes    fuzz on 8 cores, minimise and save what breaks
+//                                        as crash-<invariant>-<worker seed>.bin/.scn
+//   ./fuzz -k enemy_paddle -o crashes    same, past a known bug
+//   ./fuzz crashes/crash-ball_x-7.bin    replay one input and report
+//   ./fuzz -t crashes/crash-ball_x-7.bin print it as a button script for pingpong_sim/golden
+//
+// Every saved crash comes with its .scn trace, which pingpong_sim -s replays.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "game.h"
+#include "invariants.h"
+#include "script.h"
+#include "sim.h"
+
+#define HOLD 25
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Plays one input from power-on, checking invariants every tick
+//Parameter: Input bytes, optional coverage callback and where to put the failing tick
+//Returns: The first broken invariant, or NULL
+static const Invariant *RunInput(const uint8_t *data, size_t size, void (*cover)(void), unsigned long *fail_time)
+{
+	const Invariant *bad;
+	unsigned long until;
+	size_t n;
+
+	SimInit();
+	for(n = 0; n < size; n++){
+		until = SimTime + HOLD;
+		while(SimTime < until){
+			SimStep(data[n]);
+			if((bad = InvariantCheck())){
+				if(fail_time){
+					*fail_time = SimTime;
+				}
+				return bad;
+			}
+			if(cover){
+				cover();
+			}
+		}
+	}
+	return NULL;
+}
+
+static void ToScript(const uint8_t *data, size_t size, Script *s)
+{
+	unsigned long t = 0;
+	size_t n;
+
+	memset(s, 0, sizeof(*s));
+	for(n = 0; n < size; n++){
+		if(n == 0 || data[n] != data[n - 1]){
+			ScriptAdd(s, t, data[n]);
+		}
+		t += HOLD;
+	}
+	s->end = t;
+}
+
+#ifdef LIBFUZZER
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	const char *skip = getenv("PP_FUZZ_SKIP");
+
+	(void)argc;
+	(void)argv;
+	if(skip && InvariantSkip(skip) < 0){
+		fprintf(stderr, "PP_FUZZ_SKIP: unknown invariant in \"%s\"\n", skip);
+		exit(2);
+	}
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	unsigned long when;
+	const Invariant *bad = RunInput(data, size, NULL, &when);
+
+	if(bad){
+		fprintf(stderr, "invariant %s broken at %lu ms: %s\n", bad->name, when, bad->description);
+		abort(); // libFuzzer saves the input; -minimize_crash=1 shrinks it
+	}
+	return 0;
+}
+
+#else
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LEN 2048
+#define MODE_ODDS 16          // New samples press the mode button one time in this many
+#define MAX_CORPUS 4096
+#define COVER_BITS 20
+
+typedef struct {
+	uint8_t data[MAX_LEN];
+	size_t size;
+} Input;
+
+static Input corpus[MAX_CORPUS];
+static int corpus_count = 0;
+static uint8_t coverage[1 << (COVER_BITS - 3)];
+static int new_coverage;
+static uint64_t rng;
+
+static uint32_t Random(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (uint32_t)(rng >> 16);
+}
+
+// Coverage is which game states were reached: every task state with the ball,
+// paddles, directions, scores, game mode and the second entity, hashed into a bitmap
+static void Cover(void)
+{
+	uint32_t h = 2166136261u;
+	const unsigned char v[] = {
+		tasks[0]->state, tasks[1]->state, tasks[2]->state, tasks[3]->state,
+		BallXPosition, BallYPosition, PlayerPaddlePosition, EnemyPaddlePosition,
+		ball_xMove_left | ball_xMove_right << 1 | ball_yMove_up << 2 | ball_yMove_down << 3,
+		PlayerScore, EnemyScore, Autonomous,
+		GameMode, Entities[1].x, Entities[1].y,
+	};
+	size_t n;
+
+	for(n = 0; n < sizeof(v); n++){
+		h = (h ^ v[n]) * 16777619u;
+	}
+	h &= (1u << COVER_BITS) - 1;
+	if(!(coverage[h >> 3] & (1 << (h & 7)))){
+		coverage[h >> 3] |= 1 << (h & 7);
+		new_coverage++;
+	}
+}
+
+static void Mutate(Input *in)
+{
+	int count = 1 + Random() % 4;
+	size_t at;
+
+	while(count--){
+		switch(Random() % 6){
+			case 0: // Flip a button
+				if(in->size){
+					in->data[Random() % in->size] ^= 1 << (Random() % 8);
+				}
+			break;
+
+			case 1: // New sample
+				if(in->size){
+					in->data[Random() % in->size] = Random() % MODE_ODDS ? Random() & 0x7F : Random();
+				}
+			break;
+
+			case 2: // Insert
+				if(in->size < MAX_LEN){
+					at = in->size ? Random() % (in->size + 1) : 0;
+					memmove(in->data + at + 1, in->data + at, in->size - at);
+					in->data[at] = Random() % 3 ? Random() & 0x7F : 0;
+					if(Random() % MODE_ODDS == 0){
+						in->data[at] |= BTN_MODE;
+					}
+					in->size++;
+				}
+			break;
+
+			case 3: // Delete
+				if(in->size > 1){
+					at = Random() % in->size;
+					memmove(in->data + at, in->data + at + 1, in->size - at - 1);
+					in->size--;
+				}
+			break;
+
+			case 4: // Splice in the tail of another corpus entry
+				if(corpus_count){
+					const Input *other = &corpus[Random() % corpus_count];
+					size_t from = other->size ? Random() % other->size : 0;
+					at = in->size ? Random() % in->size : 0;
+					while(from < other->size && at < MAX_LEN){
+						in->data[at++] = other->data[from++];
+					}
+					if(at > in->size){
+						in->size = at;
+					}
+				}
+			break;
+
+			case 5: // Hold a sample for another SMBall period
+				if(in->size && in->size + 4 <= MAX_LEN){
+					at = Random() % in->size;
+					memmove(in->data + at + 4, in->data + at, in->size - at);
+					memset(in->data + at + 1, in->data[at], 3);
+					in->size += 4;
+				}
+			break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Shrinks a failing input while it still breaks the same invariant
+//Parameter: The input, and the invariant it broke
+//Returns: Nothing, the input is shrunk in place
+static void Minimise(Input *in, const Invariant *bad, unsigned long when)
+{
+	Input trial;
+	size_t chunk, at, kept;
+	unsigned long t = 0;
+
+	// Nothing after the failing tick matters
+	for(kept = 0; kept < in->size && t < when; kept++){
+		t += HOLD;
+	}
+	in->size = kept;
+
+	// Drop ever smaller chunks, then release every button that is not needed
+	for(chunk = in->size / 2; chunk >= 1; chunk /= 2){
+		for(at = 0; at + chunk <= in->size; ){
+			trial.size = in->size - chunk;
+			memcpy(trial.data, in->data, at);
+			memcpy(trial.data + at, in->data + at + chunk, in->size - at - chunk);
+			if(RunInput(trial.data, trial.size, NULL, NULL) == bad){
+				*in = trial;
+			}
+			else{
+				at += chunk;
+			}
+		}
+	}
+	for(at = 0; at < in->size; at++){
+		int bit;
+		for(bit = 7; bit >= 0; bit--){
+			if(!(in->data[at] & (1 << bit))){
+				continue;
+			}
+			trial = *in;
+			trial.data[at] &= ~(1 << bit);
+			if(RunInput(trial.data, trial.size, NULL, NULL) == bad){
+				*in = trial;
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Writes a breaking input and its .scn trace. The names carry
+//                the worker's seed, so -j workers that break the same
+//                invariant each keep their own pair
+//Parameter: Input, the invariant it breaks, crash directory, worker seed
+//Returns: None
+static void Save(const Input *in, const Invariant *bad, const char *dir, uint64_t seed)
+{
+	char path[4096];
+	Script s;
+	FILE *out;
+
+	mkdir(dir, 0777);
+	snprintf(path, sizeof(path), "%s/crash-%s-%llu.bin", dir, bad->name, (unsigned long long)seed);
+	if((out = fopen(path, "wb"))){
+		fwrite(in->data, 1, in->size, out);
+		fclose(out);
+	}
+	snprintf(path, sizeof(path), "%s/crash-%s-%llu.scn", dir, bad->name, (unsigned long long)seed);
+	if((out = fopen(path, "w"))){
+		fprintf(out, "# Breaks invariant %s: %s\n", bad->name, bad->description);
+		ToScript(in->data, in->size, &s);
+		ScriptWrite(&s, out);
+		ScriptFree(&s);
+		fclose(out);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - One fuzzing process: mutate corpus entries until something breaks
+//Parameter: Seed, number of executions, crash directory, worker number
+//Returns: 1 if an invariant broke, else 0
+static int Fuzz(uint64_t seed, unsigned long runs, const char *dir, int worker)
+{
+	const Invariant *bad;
+	unsigned long run, when;
+	struct timespec t0, t1;
+	Input in;
+
+	rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	corpus[0].size = 1;
+	corpus[0].data[0] = 0;
+	corpus_count = 1;
+
+	for(run = 0; run < runs; run++){
+		in = corpus[Random() % corpus_count];
+		Mutate(&in);
+		new_coverage = 0;
+		if((bad = RunInput(in.data, in.size, Cover, &when))){
+			printf("[%d] invariant %s broken at %lu ms after %lu runs: %s\n", worker, bad->name, when, run, bad->description);
+			Minimise(&in, bad, when);
+			Save(&in, bad, dir, seed);
+			printf("[%d] minimised to %zu sample(s), saved %s/crash-%s-%llu.bin and .scn\n", worker, in.size, dir, bad->name,
+				(unsigned long long)seed);
+			return 1;
+		}
+		if(new_coverage && corpus_count < MAX_CORPUS){
+			corpus[corpus_count++] = in;
+		}
+		if((run + 1) % 100000 == 0){
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			printf("[%d] %lu runs, corpus %d, %.0f exec/s\n", worker, run + 1, corpus_count,
+				(run + 1) / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9));
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
+
+static int LoadInput(const char *path, Input *in)
+{
+	FILE *f = fopen(path, "rb");
+
+	if(!f){
+		perror(path);
+		return -1;
+	}
+	in->size = fread(in->data, 1, MAX_LEN, f);
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "crashes";
+	unsigned long runs = 1000000, when;
+	uint64_t seed = time(NULL);
+	int jobs = 1, to_script = 0, opt, n, found = 0;
+	const Invariant *bad;
+	Input in;
+
+	while((opt = getopt(argc, argv, "j:n:s:o:k:t")) != -1){
+		switch(opt){
+			case 'j': jobs = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+			case 'n': runs = strtoul(optarg, NULL, 10); break;
+			case 's': seed = strtoull(optarg, NULL, 10); break;
+			case 'o': dir = optarg; break;
+			case 'k':
+				if(InvariantSkip(optarg) < 0){
+					fprintf(stderr, "fuzz: unknown invariant in \"%s\"\n", optarg);
+					return 2;
+				}
+			break;
+			case 't': to_script = 1; break;
+			default:
+				fprintf(stderr, "usage: fuzz [-j jobs] [-n runs] [-s seed] [-o dir] [-k skip,...] [-t] [input]\n");
+				return 2;
+		}
+	}
+
+	// Replay a saved input
+	if(optind < argc){
+		if(LoadInput(argv[optind], &in) < 0){
+			return 1;
+		}
+		if(to_script){
+			Script s;
+			ToScript(in.data, in.size, &s);
+			ScriptWrite(&s, stdout);
+			return 0;
+		}
+		if((bad = RunInput(in.data, in.size, NULL, &when))){
+			printf("invariant %s broken at %lu ms: %s\n", bad->name, when, bad->description);
+			return 1;
+		}
+		printf("no invariant broken in %lu ms\n", SimTime);
+		return 0;
+	}
+
+	if(jobs == 1){
+		return Fuzz(seed, runs, dir, 0);
+	}
+	fflush(stdout);
+	for(n = 0; n < jobs; n++){
+		if(fork() == 0){
+			found = Fuzz(seed + n, runs, dir, n);
+			fflush(stdout);
+			_exit(found);
+		}
+	}
+	for(n = 0; n < jobs; n++){
+		int status;
+		wait(&status);
+		found |= WIFEXITED(status) && WEXITSTATUS(status);
+	}
+	return found;
+}
+
+#endif
@@ -0,0 +1,178 @@
+// Declarations for the parts of main.c that the host tools reach into.
+// main.c is a single file without a header of its own, so this mirrors it:
+// keep it in step when shared variables, tasks or state enums change there.
+#ifndef HOST_GAME_H
+#define HOST_GAME_H
+
+// Scheduler
+typedef struct _task {
+	signed char state;
+	unsigned long int period;
+	unsigned long int elapsedTime;
+	int (*TickFct)(int);
+} task;
+
+// Number of states in each task's enum, in task order
+#define NUM_DISPLAY_STATES 8
+#define NUM_BALL_STATES    5
+#define NUM_PLAYER_STATES  7
+#define NUM_ENEMY_STATES   5
+
+extern task *tasks[];
+extern const unsigned short numTasks;
+extern unsigned long int GCD;
+extern volatile unsigned char TimerFlag;
+
+void SchedulerInit(void);
+void SchedulerTick(void);
+
+// Playfield geometry, see main.c; build with -DBOARD_WIDTH=/-DBOARD_HEIGHT= for other sizes
+#ifndef BOARD_WIDTH
+#define BOARD_WIDTH 8
+#endif
+#ifndef BOARD_HEIGHT
+#define BOARD_HEIGHT 8
+#endif
+
+#if BOARD_WIDTH <= 8
+typedef unsigned char row_t;
+#elif BOARD_WIDTH <= 16
+typedef unsigned short row_t;
+#else
+typedef unsigned long row_t;
+#endif
+
+#if BOARD_HEIGHT <= 8
+typedef unsigned char col_t;
+#elif BOARD_HEIGHT <= 16
+typedef unsigned short col_t;
+#else
+typedef unsigned long col_t;
+#endif
+
+#define COLUMN(x) ((row_t)1 << (x))
+#define ROW(y) ((col_t)1 << (y))
+#define TOP_ROW (BOARD_HEIGHT - 1)
+#define LEFT_COLUMN (BOARD_WIDTH - 1)
+#define PADDLE_MIN 1
+#define PADDLE_MAX (BOARD_WIDTH - 2)
+#define PADDLE_HOME (BOARD_WIDTH / 2)
+
+// Shared variables
+extern unsigned char PlayerPaddlePosition, EnemyPaddlePosition;
+extern unsigned char PlayerScore, EnemyScore;
+extern unsigned char Autonomous;
+extern unsigned char indexXpos;
+extern unsigned long i;
+extern unsigned long AIdumbifier;
+extern unsigned char Attract;
+extern unsigned long IdleTime;
+extern row_t Field[BOARD_HEIGHT];
+
+// Entities: balls and obstacles, Entities[0] is the classic ball
+#define MAX_ENTITIES 8
+
+enum Entity_Kinds { Ent_none, Ent_ball, Ent_block };
+enum Game_Modes { Mode_classic, Mode_multiball, Mode_obstacles, NUM_GAME_MODES };
+
+typedef struct _entity {
+	unsigned char kind;
+	unsigned char x, y;          // Column (0 = rightmost) and row (0 = player)
+	unsigned char left, right;
+	unsigned char up, down;
+} entity;
+
+extern entity Entities[MAX_ENTITIES];
+extern unsigned char GameMode, ModeHeld, DrawIndex;
+
+#define BallXPosition    Entities[0].x
+#define BallYPosition    Entities[0].y
+#define ball_xMove_left  Entities[0].left
+#define ball_xMove_right Entities[0].right
+#define ball_yMove_up    Entities[0].up
+#define ball_yMove_down  Entities[0].down
+
+int SMBall(int state);
+
+// Scrolling text
+#define FONT_HEIGHT 5
+
+extern row_t TextRows[FONT_HEIGHT];
+extern const char *TextPos;
+extern unsigned char TextColumn, TextTail, TextTime, TextRow, TextActive;
+extern unsigned short StackFree;
+
+// Power: demo after ATTRACT_MS without a button, power-down after SLEEP_MS
+#define ATTRACT_MS 30000
+#define SLEEP_MS 120000
+
+struct _saved_game {
+	unsigned char player, enemy;
+	unsigned char player_score, enemy_score;
+	unsigned char autonomous, index_x;
+	unsigned long i, dumbifier;
+	entity entities[MAX_ENTITIES];
+	unsigned char mode, draw;
+	unsigned char leds;
+	signed char state[4];
+	unsigned long elapsed[4];
+	row_t text_rows[FONT_HEIGHT];
+	const char *text_pos;
+	unsigned char text_column, text_tail, text_time, text_row, text_active;
+};
+
+extern struct _saved_game SavedGame;
+extern unsigned char PowerDown;
+
+void PowerTick(void);
+void PowerDownEnter(void);
+void PowerWake(void);
+void PCINT2_vect(void);
+
+// Timer
+extern unsigned long _avr_timer_M, _avr_timer_cntcurr;
+
+// Telemetry
+#define TLM_SIZE 64
+extern unsigned char TlmBuf[TLM_SIZE];
+extern volatile unsigned char TlmHead, TlmTail;
+extern unsigned char TlmDropped, TlmTime, TlmPlayerPaddle, TlmEnemyPaddle;
+
+void TlmOn(void);
+void USART0_UDRE_vect(void);
+
+// Display backend, see main.c; build with -DDISPLAY_SPI=1 for the MAX7219 chain
+#ifndef DISPLAY_SPI
+#define DISPLAY_SPI 0
+#endif
+
+#if DISPLAY_SPI
+#ifndef PANEL_MODULES_X
+#define PANEL_MODULES_X 2
+#endif
+#ifndef PANEL_MODULES_Y
+#define PANEL_MODULES_Y 1
+#endif
+#define PANEL_MODULES (PANEL_MODULES_X * PANEL_MODULES_Y)
+#define PANEL_SCALE_X (PANEL_MODULES_X * 8 / BOARD_WIDTH)   // LEDs per board column
+#define PANEL_SCALE_Y (PANEL_MODULES_Y * 8 / BOARD_HEIGHT)
+#define PANEL_FRAME_MS 15
+#define SPI_SIZE (8 * PANEL_MODULES * 2)
+
+#define MATRIX_COLS MatrixCols
+#define MATRIX_ROWS MatrixRows
+extern row_t MatrixCols;
+extern col_t MatrixRows;
+extern row_t PanelAcc[BOARD_HEIGHT];
+extern unsigned char PanelTime, PanelDropped;
+extern unsigned char SpiOut[SPI_SIZE];
+extern volatile unsigned char SpiIndex, SpiCount, SpiBusy;
+
+void PanelOn(void);
+void SPI_STC_vect(void);
+#else
+#define MATRIX_COLS PORTA
+#define MATRIX_ROWS PORTB
+#endif
+
+#endif
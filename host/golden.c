@@ -0,0 +1,449 @@
+// Golden-frame regression suite. Runs button scripts through the real main.c
+// state machines (host build), hashes every composited 15 ms frame of matrix
+// and LED output and compares the hashes with the recorded .golden files, so
+// a refactor of SMDisplay, SMBall or the paddles has to be bit-exact.
+//
+// Build: gcc -O2 -DHOST_BUILD -Ihost -o golden main.c host/avr_host.c
+//            host/sim.c host/state.c host/script.c host/golden.c
+//
+// Use:   ./golden                       check host/golden/*.scn and random.golden
+//        ./golden -j 8 some/dir         same for another directory, 8 processes
+//        ./golden -r                    re-record after an intended change
+//
+// Golden file layout: an optional "random <seed> <count> <ms>" line that asks
+// for generated scenarios, then one block per scenario:
+//
+//	scenario <name> <frames>
+//	<frame> <hash>       only frames whose hash differs from the frame before
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "script.h"
+#include "sim.h"
+
+#define RANDOM_GOLDEN "random.golden"
+
+typedef unsigned long long Hash;
+
+typedef struct {
+	char name[256];
+	Script script;
+	Hash *expected;          // One per frame, expanded from the golden file
+	unsigned long frames;
+} Scenario;
+
+typedef struct {
+	Scenario *list;
+	int count;
+} Suite;
+
+static Hash FrameHash(const SimFrame *f)
+{
+	const unsigned char *p = (const unsigned char *)f;
+	Hash h = 0xCBF29CE484222325ULL; // FNV-1a
+	size_t n;
+
+	for(n = 0; n < sizeof(*f); n++){
+		h = (h ^ p[n]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one scenario from power-on
+//Parameter: The scenario, and where to put the per-frame hashes (frames long)
+//Returns: Number of frames produced
+static unsigned long Run(Scenario *s, Hash *out, unsigned long max_frames)
+{
+	unsigned long frames = 0;
+
+	s->script.cursor = 0;
+	SimInit();
+	while(SimTime < s->script.end && frames < max_frames){
+		if(SimStep(ScriptButtons(&s->script, SimTime))){
+			out[frames++] = FrameHash(&SimLast);
+		}
+	}
+	return frames;
+}
+
+//--------Random scenarios----------------------------------------------------
+static unsigned int rng;
+
+static unsigned int Random(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+// Mostly paddle moves and pauses, with the odd start, restart, enemy move or AI toggle
+static unsigned char RandomButtons(void)
+{
+	unsigned int r = Random() % 100;
+
+	if(r < 35){
+		return 0;
+	}
+	if(r < 55){
+		return BTN_LEFT;
+	}
+	if(r < 75){
+		return BTN_RIGHT;
+	}
+	if(r < 82){
+		return BTN_START;
+	}
+	if(r < 85){
+		return BTN_RESTART;
+	}
+	if(r < 90){
+		return BTN_E_LEFT;
+	}
+	if(r < 95){
+		return BTN_E_RIGHT;
+	}
+	if(r < 97){
+		return BTN_AUTO;
+	}
+	return Random() & 0x7F;
+}
+
+static void RandomScenario(Scenario *s, unsigned int seed, int id, unsigned long length)
+{
+	unsigned long t = 0;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(s->name, sizeof(s->name), "random-%d", id);
+	rng = seed * 2654435761u + id * 40503u + 1;
+	if(!rng){
+		rng = 1;
+	}
+	ScriptAdd(&s->script, 0, 0);
+	while(t < length){
+		t += 25 + Random() % 300;
+		ScriptAdd(&s->script, t < length ? t : length, RandomButtons());
+	}
+	s->script.end = length;
+}
+//--------End Random scenarios------------------------------------------------
+
+//--------Golden files--------------------------------------------------------
+static Scenario *Find(Suite *suite, const char *name)
+{
+	int n;
+
+	for(n = 0; n < suite->count; n++){
+		if(strcmp(suite->list[n].name, name) == 0){
+			return &suite->list[n];
+		}
+	}
+	return NULL;
+}
+
+static Scenario *AddScenario(Suite *suite)
+{
+	suite->list = realloc(suite->list, (suite->count + 1) * sizeof(Scenario));
+	memset(&suite->list[suite->count], 0, sizeof(Scenario));
+	return &suite->list[suite->count++];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Reads expected hashes from a golden file into the suite
+//Parameter: Suite, golden file path, and whether a missing file is an error
+//Returns: 0 on success, -1 on error
+static int LoadGolden(Suite *suite, const char *path, int required)
+{
+	FILE *in = fopen(path, "r");
+	char line[512], name[256];
+	unsigned long frames, frame, last = 0;
+	Hash hash, current = 0;
+	Scenario *s = NULL;
+
+	if(!in){
+		if(required){
+			perror(path);
+			return -1;
+		}
+		return 0;
+	}
+	while(fgets(line, sizeof(line), in)){
+		if(line[0] == '#' || line[0] == '\n' || strncmp(line, "random ", 7) == 0){
+			continue;
+		}
+		if(sscanf(line, "scenario %255s %lu", name, &frames) == 2){
+			if(s){
+				for(; last < s->frames; last++){
+					s->expected[last] = current;
+				}
+			}
+			if((s = Find(suite, name))){
+				s->frames = frames;
+				s->expected = calloc(frames ? frames : 1, sizeof(Hash));
+			}
+			last = 0;
+			current = 0;
+		}
+		else if(sscanf(line, "%lu %llx", &frame, &hash) == 2){
+			if(!s){
+				continue; // Scenario no longer exists, it will show up as missing on -r
+			}
+			if(frame > s->frames){
+				frame = s->frames;
+			}
+			for(; last < frame; last++){
+				s->expected[last] = current;
+			}
+			current = hash;
+		}
+		else{
+			fprintf(stderr, "%s: bad line: %s", path, line);
+			fclose(in);
+			return -1;
+		}
+	}
+	if(s){
+		for(; last < s->frames; last++){
+			s->expected[last] = current;
+		}
+	}
+	fclose(in);
+	return 0;
+}
+
+static void WriteBlock(FILE *out, Scenario *s, Hash *hashes, unsigned long frames)
+{
+	unsigned long f;
+
+	fprintf(out, "scenario %s %lu\n", s->name, frames);
+	for(f = 0; f < frames; f++){
+		if(f == 0 || hashes[f] != hashes[f - 1]){
+			fprintf(out, "%lu %016llx\n", f, hashes[f]);
+		}
+	}
+}
+//--------End Golden files----------------------------------------------------
+
+// Re-runs a failing scenario up to its first bad frame and prints that frame
+static void Report(Scenario *s, unsigned long bad, Hash got)
+{
+	static const char shade[] = " .:-=+*#%@";
+	char text[4096], buttons[16];
+	int len = 0, row, col;
+	Hash *scratch = malloc((bad + 1) * sizeof(Hash));
+
+	Run(s, scratch, bad + 1);
+	free(scratch);
+	ScriptFormatButtons(ScriptButtons(&s->script, SimTime - 1), buttons);
+
+	len += snprintf(text + len, sizeof(text) - len,
+		"FAIL %s: first differing frame %lu (%lu-%lu ms), buttons %s\n  got %016llx, expected %016llx\n",
+		s->name, bad, bad * SIM_FRAME_MS, (bad + 1) * SIM_FRAME_MS - 1, buttons, got, s->expected[bad]);
+	for(row = BOARD_HEIGHT - 1; row >= 0; row--){
+		len += snprintf(text + len, sizeof(text) - len, "  |");
+		for(col = BOARD_WIDTH - 1; col >= 0; col--){
+			len += snprintf(text + len, sizeof(text) - len, "%c", shade[SimLast.pixel[row][col] * 9 / SIM_FRAME_MS]);
+		}
+		len += snprintf(text + len, sizeof(text) - len, "|\n");
+	}
+	len += snprintf(text + len, sizeof(text) - len, "  LEDs ");
+	for(col = 7; col >= 0; col--){
+		len += snprintf(text + len, sizeof(text) - len, "%c", shade[SimLast.led[col] * 9 / SIM_FRAME_MS]);
+	}
+	len += snprintf(text + len, sizeof(text) - len, "\n");
+	fwrite(text, 1, len, stdout); // One write, workers share stdout
+	fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Checks every scenario whose index is worker mod jobs
+//Parameter: Suite, this worker's number and the number of workers
+//Returns: Number of failing scenarios
+static int Check(Suite *suite, int worker, int jobs)
+{
+	unsigned long frames, f;
+	int n, failed = 0;
+	Hash *hashes;
+
+	for(n = worker; n < suite->count; n += jobs){
+		Scenario *s = &suite->list[n];
+
+		if(!s->expected){
+			printf("FAIL %s: no golden hashes recorded, run with -r\n", s->name);
+			failed++;
+			continue;
+		}
+		hashes = malloc((s->frames + 1) * sizeof(Hash));
+		frames = Run(s, hashes, s->frames + 1);
+		for(f = 0; f < frames && f < s->frames; f++){
+			if(hashes[f] != s->expected[f]){
+				break;
+			}
+		}
+		if(f < frames && f < s->frames){
+			Report(s, f, hashes[f]);
+			failed++;
+		}
+		else if(frames != s->frames){
+			printf("FAIL %s: %lu frames, expected %lu\n", s->name, frames, s->frames);
+			failed++;
+		}
+		free(hashes);
+	}
+	return failed;
+}
+
+static int Record(Suite *suite, int first, int count, const char *path, const char *header)
+{
+	FILE *out = fopen(path, "w");
+	int n;
+
+	if(!out){
+		perror(path);
+		return -1;
+	}
+	fprintf(out, "# Golden frame hashes, regenerate with golden -r\n");
+	if(header){
+		fprintf(out, "%s\n", header);
+	}
+	for(n = first; n < first + count; n++){
+		Scenario *s = &suite->list[n];
+		unsigned long max = s->script.end / SIM_FRAME_MS + 1;
+		Hash *hashes = malloc(max * sizeof(Hash));
+		WriteBlock(out, s, hashes, Run(s, hashes, max));
+		free(hashes);
+	}
+	fclose(out);
+	return 0;
+}
+
+static int ByName(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "host/golden";
+	char path[4096], header[128];
+	unsigned int seed = 1;
+	unsigned long length = 2000;
+	int random_count = 0, record = 0, jobs = 1, opt, n, failed = 0, scripted;
+	Suite suite = { NULL, 0 };
+	char **names = NULL;
+	int name_count = 0;
+	struct dirent *entry;
+	struct timespec t0, t1;
+	DIR *d;
+	FILE *in;
+
+	while((opt = getopt(argc, argv, "rj:")) != -1){
+		switch(opt){
+			case 'r': record = 1; break;
+			case 'j': jobs = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+			default:
+				fprintf(stderr, "usage: golden [-r] [-j jobs] [dir]\n");
+				return 2;
+		}
+	}
+	if(optind < argc){
+		dir = argv[optind];
+	}
+
+	// Hand-written scenarios: every *.scn in dir, in name order
+	if(!(d = opendir(dir))){
+		perror(dir);
+		return 1;
+	}
+	while((entry = readdir(d))){
+		size_t len = strlen(entry->d_name);
+		if(len > 4 && strcmp(entry->d_name + len - 4, ".scn") == 0){
+			names = realloc(names, (name_count + 1) * sizeof(char *));
+			names[name_count++] = strdup(entry->d_name);
+		}
+	}
+	closedir(d);
+	qsort(names, name_count, sizeof(char *), ByName);
+	for(n = 0; n < name_count; n++){
+		Scenario *s = AddScenario(&suite);
+		snprintf(s->name, sizeof(s->name), "%s", names[n]);
+		snprintf(path, sizeof(path), "%s/%s", dir, names[n]);
+		if(ScriptLoad(&s->script, path) < 0){
+			return 1;
+		}
+	}
+	scripted = suite.count;
+
+	// Generated scenarios, as described by the first line of random.golden
+	snprintf(path, sizeof(path), "%s/%s", dir, RANDOM_GOLDEN);
+	if((in = fopen(path, "r"))){
+		char line[256];
+		while(fgets(line, sizeof(line), in)){
+			if(sscanf(line, "random %u %d %lu", &seed, &random_count, &length) == 3){
+				break;
+			}
+		}
+		fclose(in);
+	}
+	for(n = 0; n < random_count; n++){
+		RandomScenario(AddScenario(&suite), seed, n, length);
+	}
+
+	if(record){
+		for(n = 0; n < scripted; n++){
+			snprintf(path, sizeof(path), "%s/%.*s.golden", dir, (int)strlen(names[n]) - 4, names[n]);
+			if(Record(&suite, n, 1, path, NULL) < 0){
+				return 1;
+			}
+		}
+		if(random_count){
+			snprintf(path, sizeof(path), "%s/%s", dir, RANDOM_GOLDEN);
+			snprintf(header, sizeof(header), "random %u %d %lu", seed, random_count, length);
+			if(Record(&suite, scripted, random_count, path, header) < 0){
+				return 1;
+			}
+		}
+		printf("recorded %d scenario(s)\n", suite.count);
+		return 0;
+	}
+
+	for(n = 0; n < scripted; n++){
+		snprintf(path, sizeof(path), "%s/%.*s.golden", dir, (int)strlen(names[n]) - 4, names[n]);
+		if(LoadGolden(&suite, path, 0) < 0){
+			return 1;
+		}
+	}
+	snprintf(path, sizeof(path), "%s/%s", dir, RANDOM_GOLDEN);
+	if(random_count && LoadGolden(&suite, path, 1) < 0){
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if(jobs == 1){
+		failed = Check(&suite, 0, 1);
+	}
+	else{
+		fflush(stdout);
+		for(n = 0; n < jobs; n++){
+			if(fork() == 0){
+				int result = Check(&suite, n, jobs);
+				_exit(result > 255 ? 255 : result);
+			}
+		}
+		for(n = 0; n < jobs; n++){
+			int status;
+			wait(&status);
+			failed += WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%d of %d scenario(s) passed in %.2f s\n", suite.count - failed, suite.count,
+		(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return failed ? 1 : 0;
+}
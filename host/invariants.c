@@ -0,0 +1,126 @@
+// Game invariants, see invariants.h.
+#include <string.h>
+#include "game.h"
+#include "invariants.h"
+
+enum { Inv_ball_x, Inv_ball_y, Inv_ball_dir, Inv_player_paddle, Inv_enemy_paddle, Inv_score, Inv_states,
+	Inv_entities, Inv_mode, Inv_block, Inv_ball_in_block };
+
+const Invariant Invariants[] = {
+	{ "ball_x",        "every ball's column is on the board" },
+	{ "ball_y",        "every ball's row is on the board" },
+	{ "ball_dir",      "every ball moves exactly one way on each axis" },
+	{ "player_paddle", "PlayerPaddlePosition is PADDLE_MIN..PADDLE_MAX" },
+	{ "enemy_paddle",  "EnemyPaddlePosition is PADDLE_MIN..PADDLE_MAX" },
+	{ "score",         "PlayerScore and EnemyScore are at most 4" },
+	{ "states",        "every task state is a value of its enum" },
+	{ "entities",      "Entities[0] is a ball and every entity is a ball, an obstacle or unused" },
+	{ "mode",          "the entities are GameMode's layout: 1 ball, 2 balls (multi-ball) or 1 ball and 2 obstacles" },
+	{ "block",         "every obstacle is on the board, between the paddle rows" },
+	{ "ball_in_block", "no ball is on an obstacle" },
+};
+const int InvariantCount = sizeof(Invariants) / sizeof(Invariants[0]);
+
+static unsigned int skipped = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Turns off invariants by name
+//Parameter: Comma separated names, e.g. "enemy_paddle,score"
+//Returns: 0, or -1 if a name is unknown
+int InvariantSkip(const char *names)
+{
+	char buf[256], *name;
+	int n;
+
+	strncpy(buf, names, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	for(name = strtok(buf, ","); name; name = strtok(NULL, ",")){
+		n = 0;
+		while(n < InvariantCount && strcmp(Invariants[n].name, name) != 0){
+			n++;
+		}
+		if(n == InvariantCount){
+			return -1;
+		}
+		skipped |= 1u << n;
+	}
+	return 0;
+}
+
+static int PaddleOk(unsigned char pos)
+{
+	return pos >= PADDLE_MIN && pos <= PADDLE_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Checks every invariant that has not been skipped
+//Parameter: None, reads main.c's shared variables
+//Returns: The first invariant that does not hold, or NULL
+const Invariant *InvariantCheck(void)
+{
+	static const unsigned char state_count[] = { NUM_DISPLAY_STATES, NUM_BALL_STATES, NUM_PLAYER_STATES, NUM_ENEMY_STATES };
+	// Balls and obstacles each mode lays out, in Game_Modes order
+	static const unsigned char mode_balls[NUM_GAME_MODES] = { 1, 2, 1 };
+	static const unsigned char mode_blocks[NUM_GAME_MODES] = { 0, 0, 2 };
+	unsigned int bad = 0;
+	unsigned char balls = 0, blocks = 0;
+	unsigned short t;
+	int n, m;
+
+	for(n = 0; n < MAX_ENTITIES; n++){
+		const entity *b = &Entities[n];
+		if(b->kind == Ent_block){
+			blocks++;
+			if(b->x >= BOARD_WIDTH || b->y == 0 || b->y >= TOP_ROW){
+				bad |= 1u << Inv_block;
+			}
+			continue;
+		}
+		if(b->kind != Ent_ball){
+			if(b->kind != Ent_none || n == 0){
+				bad |= 1u << Inv_entities;
+			}
+			continue;
+		}
+		balls++;
+		if(b->x >= BOARD_WIDTH){
+			bad |= 1u << Inv_ball_x;
+		}
+		if(b->y >= BOARD_HEIGHT){
+			bad |= 1u << Inv_ball_y;
+		}
+		if(b->left + b->right != 1 || b->up + b->down != 1){
+			bad |= 1u << Inv_ball_dir;
+		}
+		for(m = 0; m < MAX_ENTITIES; m++){
+			if(Entities[m].kind == Ent_block && Entities[m].x == b->x && Entities[m].y == b->y){
+				bad |= 1u << Inv_ball_in_block;
+			}
+		}
+	}
+	if(GameMode >= NUM_GAME_MODES || balls != mode_balls[GameMode] || blocks != mode_blocks[GameMode]){
+		bad |= 1u << Inv_mode;
+	}
+	if(!PaddleOk(PlayerPaddlePosition)){
+		bad |= 1u << Inv_player_paddle;
+	}
+	if(!PaddleOk(EnemyPaddlePosition)){
+		bad |= 1u << Inv_enemy_paddle;
+	}
+	if(PlayerScore > 4 || EnemyScore > 4){
+		bad |= 1u << Inv_score;
+	}
+	for(t = 0; t < numTasks && t < 4; t++){
+		if(tasks[t]->state < 0 || tasks[t]->state >= state_count[t]){
+			bad |= 1u << Inv_states;
+		}
+	}
+
+	bad &= ~skipped;
+	for(n = 0; n < InvariantCount; n++){
+		if(bad & (1u << n)){
+			return &Invariants[n];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,17 @@
+// Game invariants the host tools check after every tick. Each one has a short
+// name so a known failure can be switched off while hunting for the next.
+#ifndef HOST_INVARIANTS_H
+#define HOST_INVARIANTS_H
+
+typedef struct {
+	const char *name;
+	const char *description;
+} Invariant;
+
+extern const Invariant Invariants[];
+extern const int InvariantCount;
+
+int InvariantSkip(const char *names);
+const Invariant *InvariantCheck(void);
+
+#endif
@@ -0,0 +1,88 @@
+// MAX7219 chain decoder, see max7219.h.
+#include <string.h>
+#include "max7219.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Powers a chain up: registers cleared, every module in shutdown
+//Parameter: The chain, modules across and down; module 0 is nearest the MCU at
+//           the bottom right, the chain runs right to left, then up a row
+//Returns: Nothing
+void Max7219Init(Max7219Chain *c, int across, int down)
+{
+	memset(c, 0, sizeof(*c));
+	c->across = across;
+	c->down = down;
+	c->modules = across * down;
+	if(c->modules > MAX7219_CHAIN){
+		c->modules = MAX7219_CHAIN;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Clocks one byte into the chain, MSB first; what drops out of
+//                DOUT of one module goes on into the next
+//Parameter: The chain, the byte
+//Returns: Nothing
+void Max7219Byte(Max7219Chain *c, unsigned char byte)
+{
+	unsigned char out = byte;
+	int k;
+
+	for(k = 0; k < c->modules; k++){
+		unsigned char next = c->chip[k].shift >> 8;
+		c->chip[k].shift = (unsigned short)((c->chip[k].shift << 8) | out);
+		out = next;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - LOAD rising edge: every module takes the word in its shift register
+//Parameter: The chain
+//Returns: Nothing
+void Max7219Latch(Max7219Chain *c)
+{
+	int k;
+
+	c->latches++;
+	for(k = 0; k < c->modules; k++){
+		Max7219 *m = &c->chip[k];
+		unsigned char reg = (m->shift >> 8) & 0x0F;
+		unsigned char data = m->shift & 0xFF;
+
+		switch(reg){
+			case 0x00: break; // No-op
+			case 0x09: m->decode = data; break;
+			case 0x0A: m->intensity = data & 0x0F; break;
+			case 0x0B: m->scan_limit = data & 0x07; break;
+			case 0x0C: m->shutdown = data & 0x01; break;
+			case 0x0F: m->test = data & 0x01; break;
+			default:
+				if(reg >= 0x01 && reg <= 0x08){
+					m->digit[reg - 1] = data;
+				}
+				break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Whether an LED of the panel is lit
+//Parameter: The chain, column from the left, row from the bottom
+//Returns: 1 if lit, 0 if not
+int Max7219Pixel(const Max7219Chain *c, int x, int y)
+{
+	const Max7219 *m;
+	int digit = y % 8;
+
+	if(x < 0 || y < 0 || x >= c->across * 8 || y >= c->down * 8){
+		return 0;
+	}
+	m = &c->chip[(y / 8) * c->across + (c->across - 1 - x / 8)];
+	if(m->test){
+		return 1;
+	}
+	if(!m->shutdown || digit > m->scan_limit){
+		return 0;
+	}
+	return (m->digit[digit] >> (7 - x % 8)) & 1;
+}
@@ -0,0 +1,27 @@
+// Host stand-in for a daisy chain of MAX7219 8x8 LED drivers. Feed it the
+// bytes main.c clocks out of SPDR and tell it when LOAD rises; it keeps the
+// registers of every module the way the chips would, so the tools can read
+// back what the panel shows.
+#ifndef HOST_MAX7219_H
+#define HOST_MAX7219_H
+
+#define MAX7219_CHAIN 8 // Most modules a chain can have here
+
+typedef struct {
+	unsigned short shift;      // 16-bit input shift register
+	unsigned char digit[8];    // Digit registers 1-8, segment bit 7 = leftmost column
+	unsigned char decode, intensity, scan_limit, shutdown, test;
+} Max7219;
+
+typedef struct {
+	int modules, across, down; // Chain length and how the modules are arranged
+	Max7219 chip[MAX7219_CHAIN];
+	unsigned long latches;     // LOAD rising edges seen
+} Max7219Chain;
+
+void Max7219Init(Max7219Chain *c, int across, int down);
+void Max7219Byte(Max7219Chain *c, unsigned char byte);
+void Max7219Latch(Max7219Chain *c);
+int Max7219Pixel(const Max7219Chain *c, int x, int y);
+
+#endif
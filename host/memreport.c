@@ -0,0 +1,249 @@
+// SRAM and flash used by each part of main.c, read from the symbol table of a
+// build, and checked against host/memory_budget.txt.
+//
+// Build: gcc -O2 -o memreport host/memreport.c host/elf.c
+//
+// Use:   avr-gcc -mmcu=atmega1284 -DF_CPU=8000000UL -Os -o pingpong.elf main.c
+//        ./memreport pingpong.elf                                report only
+//        ./memreport -b host/memory_budget.txt pingpong.elf      exit 1 when a module is over budget
+//        ./memreport -v ...                                      list every symbol under its module
+//        ./memreport -s 4096 -f 65536 ...                        other SRAM/flash sizes (default ATmega1284)
+//
+// A module is a list of symbol patterns from the budget file; symbols that
+// match none are counted as "other". On an AVR executable the address tells
+// SRAM (0x800000 up) from flash, and initialised data counts in both, since
+// its start values are copied from flash. Other files (a host build of
+// main.c, say) are sorted by section flags instead; their sizes are the
+// host's, not the AVR's.
+#include <elf.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "elf.h"
+
+#define MAX_MODULES 32
+#define MAX_PATTERNS 512
+#define AVR_SRAM_START 0x800000UL
+#define AVR_SRAM_END 0x810000UL   // .eeprom and the fuses sit above
+
+typedef struct {
+	char name[32];
+	long sram_budget, flash_budget;  // -1: no budget
+	unsigned long sram, flash;
+} Module;
+
+typedef struct {
+	char text[128];
+	int module;
+} Pattern;
+
+static Module modules[MAX_MODULES];
+static int module_count;
+static Pattern patterns[MAX_PATTERNS];
+static int pattern_count;
+static long stack_min = -1;       // "stack" line of the budget file
+
+static int AddModule(const char *name, long sram, long flash)
+{
+	Module *m = &modules[module_count];
+
+	snprintf(m->name, sizeof(m->name), "%s", name);
+	m->sram_budget = sram;
+	m->flash_budget = flash;
+	return module_count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Reads the budget file:
+//                  # comment
+//                  stack   <bytes>                      SRAM that must stay free
+//                  <module> <sram> <flash> <pattern>...  "-" for no budget
+//Parameter: File name
+//Returns: 0, or -1 with a message on stderr
+static int LoadBudget(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[1024], *word, *name, *end;
+	long sram, flash;
+	int number = 0, m;
+
+	if(!f){
+		perror(path);
+		return -1;
+	}
+	while(fgets(line, sizeof(line), f)){
+		number++;
+		if((end = strchr(line, '#'))){
+			*end = 0;
+		}
+		if(!(name = strtok(line, " \t\r\n"))){
+			continue;
+		}
+		if(strcmp(name, "stack") == 0){
+			word = strtok(NULL, " \t\r\n");
+			stack_min = word ? strtol(word, NULL, 0) : -1;
+			continue;
+		}
+		word = strtok(NULL, " \t\r\n");
+		sram = (!word || strcmp(word, "-") == 0) ? -1 : strtol(word, NULL, 0);
+		word = strtok(NULL, " \t\r\n");
+		flash = (!word || strcmp(word, "-") == 0) ? -1 : strtol(word, NULL, 0);
+		if(!word || module_count == MAX_MODULES){
+			fprintf(stderr, "%s:%d: expected <module> <sram> <flash> <pattern>...\n", path, number);
+			fclose(f);
+			return -1;
+		}
+		m = AddModule(name, sram, flash);
+		while((word = strtok(NULL, " \t\r\n")) && pattern_count < MAX_PATTERNS){
+			snprintf(patterns[pattern_count].text, sizeof(patterns[0].text), "%s", word);
+			patterns[pattern_count++].module = m;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static int ModuleOf(const char *symbol, int other)
+{
+	int n;
+
+	for(n = 0; n < pattern_count; n++){
+		if(fnmatch(patterns[n].text, symbol, 0) == 0){
+			return patterns[n].module;
+		}
+	}
+	return other;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Works out what a section costs in SRAM and in flash
+//Parameter: The file, the section, where to put the two flags
+//Returns: Nothing; both flags 0 for sections that are not loaded
+static void Memories(const Elf *e, const ElfSection *s, int *sram, int *flash)
+{
+	int bits = s->type != SHT_NOBITS;
+
+	*sram = *flash = 0;
+	if(!(s->flags & SHF_ALLOC)){
+		return;
+	}
+	if(e->machine == EM_AVR && e->type == ET_EXEC){
+		if(s->addr >= AVR_SRAM_START && s->addr < AVR_SRAM_END){
+			*sram = 1;
+			*flash = bits;
+		}
+		else if(s->addr < AVR_SRAM_START){
+			*flash = 1;
+		}
+		return;
+	}
+	if(s->flags & SHF_WRITE){
+		*sram = 1;
+		*flash = bits;
+	}
+	else{
+		*flash = 1;
+	}
+}
+
+static void Cell(unsigned long used, long budget, int *over)
+{
+	if(budget < 0){
+		printf(" %7lu        ", used);
+	}
+	else if(used > (unsigned long)budget){
+		printf(" %7lu >%-6ld", used, budget);
+		*over = 1;
+	}
+	else{
+		printf(" %7lu /%-6ld", used, budget);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *budget = NULL;
+	unsigned long sram_size = 16384, flash_size = 131072;
+	unsigned long sram_total = 0, flash_total = 0, sram_syms = 0, flash_syms = 0, left;
+	int verbose = 0, over = 0, other, opt, n, m, sram, flash;
+	Elf e;
+
+	while((opt = getopt(argc, argv, "b:s:f:v")) != -1){
+		switch(opt){
+			case 'b': budget = optarg; break;
+			case 's': sram_size = strtoul(optarg, NULL, 0); break;
+			case 'f': flash_size = strtoul(optarg, NULL, 0); break;
+			case 'v': verbose = 1; break;
+			default:
+				fprintf(stderr, "usage: memreport [-b budget] [-s sram] [-f flash] [-v] file.elf\n");
+				return 2;
+		}
+	}
+	if(optind + 1 != argc){
+		fprintf(stderr, "usage: memreport [-b budget] [-s sram] [-f flash] [-v] file.elf\n");
+		return 2;
+	}
+	if(budget && LoadBudget(budget)){
+		return 2;
+	}
+	other = AddModule("other", -1, -1);
+	for(n = 0; n < other; n++){
+		if(strcmp(modules[n].name, "other") == 0){
+			other = n; // The budget file gave "other" a line of its own
+			module_count--;
+			break;
+		}
+	}
+	if(ElfLoad(&e, argv[optind])){
+		return 2;
+	}
+
+	for(n = 0; n < e.section_count; n++){
+		Memories(&e, &e.sections[n], &sram, &flash);
+		sram_total += sram ? e.sections[n].size : 0;
+		flash_total += flash ? e.sections[n].size : 0;
+	}
+	for(n = 0; n < e.symbol_count; n++){
+		const ElfSymbol *y = &e.symbols[n];
+
+		if(!y->section || !y->size || (y->type != STT_OBJECT && y->type != STT_FUNC)){
+			continue;
+		}
+		Memories(&e, &e.sections[y->section], &sram, &flash);
+		m = ModuleOf(y->name, other);
+		modules[m].sram += sram ? y->size : 0;
+		modules[m].flash += flash ? y->size : 0;
+		sram_syms += sram ? y->size : 0;
+		flash_syms += flash ? y->size : 0;
+		if(verbose && (sram || flash)){
+			printf("%-12s %-32s %6lu %s%s\n", modules[m].name, y->name, y->size,
+				sram ? "sram" : "", flash ? (sram ? "+flash" : "flash") : "");
+		}
+	}
+	// Start-up code, vector table, alignment: anything without a sized symbol
+	modules[other].sram += sram_total - sram_syms;
+	modules[other].flash += flash_total - flash_syms;
+
+	printf("%-12s %15s %15s\n", "module", "sram / budget", "flash / budget");
+	for(n = 0; n < module_count; n++){
+		printf("%-12s", modules[n].name);
+		Cell(modules[n].sram, modules[n].sram_budget, &over);
+		Cell(modules[n].flash, modules[n].flash_budget, &over);
+		printf("\n");
+	}
+	left = sram_total < sram_size ? sram_size - sram_total : 0;
+	printf("SRAM  %7lu bytes: %lu static, %lu left for the stack", sram_size, sram_total, left);
+	if(stack_min >= 0){
+		printf(" (at least %ld)%s", stack_min, left < (unsigned long)stack_min ? " TOO LITTLE" : "");
+		over |= left < (unsigned long)stack_min;
+	}
+	printf("\nFlash %7lu bytes: %lu used%s\n", flash_size, flash_total, flash_total > flash_size ? " TOO MUCH" : "");
+	over |= flash_total > flash_size;
+	if(over && budget){
+		printf("over budget (marked >)\n");
+	}
+	ElfFree(&e);
+	return over && budget;
+}
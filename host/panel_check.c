@@ -0,0 +1,136 @@
+// Checks the SPI display backend: plays button scripts on a DISPLAY_SPI build
+// of main.c, decodes what it clocks out to the MAX7219 chain (host/max7219.c)
+// and compares every panel frame with what MatrixCols/MatrixRows showed over
+// the same milliseconds, scaled up to the panel where it is twice the board.
+// In power-down the panel has to be dark.
+//
+// Build: gcc -O2 -DHOST_BUILD -DDISPLAY_SPI=1 -Ihost -o panel_check main.c
+//            host/avr_host.c host/sim.c host/state.c host/script.c host/max7219.c
+//            host/panel_check.c
+//        add -DPANEL_MODULES_Y=2 for the 16x16 panel, -DPANEL_MODULES_X=1 for a single module,
+//        -DBOARD_WIDTH=16 for a board as wide as the default panel
+//
+// Use:   ./panel_check host/golden/*.scn       every frame of every script
+//        ./panel_check -v host/golden/rally.scn   also print the last panel frame
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "avr/interrupt.h"
+#include "game.h"
+#include "script.h"
+#include "sim.h"
+
+#if !DISPLAY_SPI
+#error "panel_check needs a DISPLAY_SPI=1 build"
+#endif
+
+#define PANEL_W (PANEL_MODULES_X * 8)
+#define PANEL_H (PANEL_MODULES_Y * 8)
+
+static void Print(void)
+{
+	int x, y;
+
+	for(y = PANEL_H - 1; y >= 0; y--){
+		printf("  |");
+		for(x = 0; x < PANEL_W; x++){
+			putchar(Max7219Pixel(&SimPanel, x, y) ? 'o' : ' ');
+		}
+		printf("|\n");
+	}
+}
+
+static row_t Seen[BOARD_HEIGHT]; // Board pixels lit since the panel last got a frame
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Compares the decoded panel with what the matrix showed
+//Parameter: 1 to expect a dark panel (power-down), 0 to expect Seen
+//Returns: 0 if they match, 1 otherwise (and prints the first difference)
+static int Compare(int dark)
+{
+	int x, y, want;
+
+	for(y = 0; y < PANEL_H; y++){
+		for(x = 0; x < PANEL_W; x++){
+			// Panel column x shows board column LEFT_COLUMN - x / PANEL_SCALE_X, column 0 is on the right
+			want = !dark && (Seen[y / PANEL_SCALE_Y] & COLUMN(LEFT_COLUMN - x / PANEL_SCALE_X)) != 0;
+			if(Max7219Pixel(&SimPanel, x, y) != want){
+				printf("  pixel (%d, %d) is %s, the matrix has it %s\n", x, y, want ? "off" : "on", want ? "on" : "off");
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one script from power-on and checks every frame
+//Parameter: Script file, print the last frame
+//Returns: 0 if every frame matched, 1 otherwise
+static int Check(const char *path, int verbose)
+{
+	Script s;
+	unsigned long frames = 0;
+	int row, dark, sim;
+
+	if(ScriptLoad(&s, path)){
+		return 1;
+	}
+	SimInit();
+	memset(Seen, 0, sizeof(Seen));
+	while(SimTime < s.end){
+		sim = SimStep(ScriptButtons(&s, SimTime));
+		dark = (SMCR & 0x01) != 0;
+		if(dark){
+			// Power-down: the panel is shut down and the next frame starts after the wake-up
+			memset(Seen, 0, sizeof(Seen));
+		}
+		else{
+			for(row = 0; row < BOARD_HEIGHT; row++){
+				if(!(MatrixRows & ROW(row))){
+					Seen[row] |= MatrixCols;
+				}
+			}
+		}
+		// Frames follow PanelTime, which stops in power-down; sim frames go on in there
+		if(dark ? sim : PanelTime == 0){
+			frames++;
+			if(Compare(dark)){
+				printf("FAIL %s: frame %lu (%lu ms)\n", path, frames - 1, SimTime);
+				Print();
+				ScriptFree(&s);
+				return 1;
+			}
+			memset(Seen, 0, sizeof(Seen));
+		}
+	}
+	printf("ok   %s: %lu frames, %lu latches, %u dropped\n", path, frames, SimPanel.latches, PanelDropped);
+	if(verbose){
+		Print();
+	}
+	ScriptFree(&s);
+	return PanelDropped != 0;
+}
+
+int main(int argc, char **argv)
+{
+	int verbose = 0, failed = 0, opt;
+
+	while((opt = getopt(argc, argv, "v")) != -1){
+		switch(opt){
+			case 'v': verbose = 1; break;
+			default:
+				fprintf(stderr, "usage: panel_check [-v] script.scn...\n");
+				return 2;
+		}
+	}
+	if(optind >= argc){
+		fprintf(stderr, "usage: panel_check [-v] script.scn...\n");
+		return 2;
+	}
+	printf("%dx%d panel, %d module(s)\n", PANEL_W, PANEL_H, PANEL_MODULES);
+	for(; optind < argc; optind++){
+		failed |= Check(argv[optind], verbose);
+	}
+	return failed;
+}
@@ -0,0 +1,253 @@
+// Host simulator front end: runs the real main.c state machines and shows the
+// matrix (BOARD_WIDTH x BOARD_HEIGHT) and the PORTD score LEDs in the terminal and/or as PNG frames.
+//
+// Build: gcc -O2 -DHOST_BUILD -Ihost -o pingpong_sim main.c host/avr_host.c
+//            host/sim.c host/state.c host/script.c host/png.c host/pingpong_sim.c -lm
+//
+// Use:   ./pingpong_sim                      play from the keyboard in real time
+//        ./pingpong_sim -s rally.scn -x 8    replay a script at 8x speed
+//        ./pingpong_sim -s rally.scn -q -o frames/   dump every frame as PNG
+//        ./pingpong_sim -s rally.scn -q -T tlm.bin   telemetry capture
+//
+// Keys: a/d player left/right, s start, x restart, j/l enemy left/right,
+//       t autonomous toggle, m game mode, q quit. A key counts as held for KEY_HOLD_MS
+//       after it was last seen, which the terminal's auto-repeat keeps alive.
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "png.h"
+#include "script.h"
+#include "sim.h"
+
+#define KEY_HOLD_MS 150
+#define CELL 16 // PNG pixels per matrix LED
+#define PNG_COLS (BOARD_WIDTH > 8 ? BOARD_WIDTH : 8)   // Wide enough for the matrix and the 8 LEDs
+#define PNG_ROWS (BOARD_HEIGHT + 2)                    // Matrix, a gap, the LEDs
+
+static struct termios saved_tty;
+static int raw_tty = 0;
+
+static void RestoreTerminal(void)
+{
+	if(raw_tty){
+		tcsetattr(STDIN_FILENO, TCSANOW, &saved_tty);
+		printf("\x1b[0m\x1b[?25h\n");
+	}
+}
+
+static void RawTerminal(void)
+{
+	struct termios tty;
+
+	tcgetattr(STDIN_FILENO, &saved_tty);
+	tty = saved_tty;
+	tty.c_lflag &= ~(ICANON | ECHO);
+	tty.c_cc[VMIN] = 0;
+	tty.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &tty);
+	raw_tty = 1;
+	atexit(RestoreTerminal);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Reads pending keys and works out which buttons are held
+//Parameter: Current simulated time in ms
+//Returns: PINC-ordered button mask, or -1 when q was pressed
+static int ReadKeys(unsigned long now)
+{
+	static const char keys[] = "adsxjltm";
+	static unsigned long last_seen[8];
+	static int seen[8];
+	unsigned char buttons = 0;
+	const char *p;
+	char c;
+	int n;
+
+	while(read(STDIN_FILENO, &c, 1) == 1){
+		if(c == 'q'){
+			return -1;
+		}
+		if(c && (p = strchr(keys, c))){
+			last_seen[p - keys] = now;
+			seen[p - keys] = 1;
+		}
+	}
+	for(n = 0; n < 8; n++){
+		if(seen[n] && now - last_seen[n] < KEY_HOLD_MS){
+			buttons |= 1 << n;
+		}
+	}
+	return buttons;
+}
+
+// Perceived brightness of an LED that was on for `on` of SIM_FRAME_MS ms.
+// The square root lifts the 1/3 duty of the multiplexed rows the way the eye does.
+static unsigned char Level(unsigned char on)
+{
+	return (unsigned char)(255.0 * sqrt((double)on / SIM_FRAME_MS) + 0.5);
+}
+
+// Column LEFT_COLUMN is the leftmost and row TOP_ROW is the enemy side at the top
+static void DrawTerminal(const SimFrame *f, unsigned long now)
+{
+	int row, col;
+
+	printf("\x1b[H");
+	for(row = TOP_ROW; row >= 0; row--){
+		for(col = LEFT_COLUMN; col >= 0; col--){
+			printf("\x1b[48;2;%d;0;0m  ", Level(f->pixel[row][col]));
+		}
+		printf("\x1b[0m\n");
+	}
+	printf("\n");
+	for(col = 7; col >= 0; col--){
+		printf("\x1b[38;2;0;%d;0m\xe2\x97\x8f ", Level(f->led[col]) / 2 + 40);
+	}
+	printf("\x1b[0m  %8.3f s\n", now / 1000.0);
+	fflush(stdout);
+}
+
+static void DumpPng(const SimFrame *f, const char *dir, unsigned long frame)
+{
+	static unsigned char rgb[PNG_COLS * CELL * PNG_ROWS * CELL * 3];
+	int width = PNG_COLS * CELL, row, col, x, y;
+	char path[4096];
+
+	memset(rgb, 0, sizeof(rgb));
+	for(row = 0; row < BOARD_HEIGHT; row++){
+		for(col = 0; col < BOARD_WIDTH; col++){
+			for(y = 1; y < CELL - 1; y++){
+				for(x = 1; x < CELL - 1; x++){
+					unsigned char *p = rgb + (((TOP_ROW - row) * CELL + y) * width + (LEFT_COLUMN - col) * CELL + x) * 3;
+					p[0] = Level(f->pixel[row][col]);
+				}
+			}
+		}
+	}
+	// The LEDs go in the last row, one cell below the matrix
+	for(col = 0; col < 8; col++){
+		for(y = 3; y < CELL - 3; y++){
+			for(x = 3; x < CELL - 3; x++){
+				unsigned char *p = rgb + (((PNG_ROWS - 1) * CELL + y) * width + (7 - col) * CELL + x) * 3;
+				p[1] = Level(f->led[col]);
+			}
+		}
+	}
+	snprintf(path, sizeof(path), "%s/frame_%06lu.png", dir, frame);
+	PngWrite(path, width, PNG_ROWS * CELL, rgb);
+}
+
+static double WallMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: pingpong_sim [-s script] [-n ms] [-x speed] [-e every] [-o dir] [-T telemetry.bin] [-q]\n"
+		"  -s  read buttons from a script instead of the keyboard\n"
+		"  -n  stop after this many ms (default: end of script, or never)\n"
+		"  -x  speed as a multiple of real time, 0 = as fast as possible (default 1, or 0 with -s)\n"
+		"  -e  only draw every Nth frame in the terminal\n"
+		"  -o  write every frame to dir/frame_NNNNNN.png\n"
+		"  -T  capture the telemetry stream for tlm_decode\n"
+		"  -q  no terminal output\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	Script script;
+	const char *script_path = NULL, *png_dir = NULL;
+	unsigned long stop = 0, frame = 0, every = 1;
+	double speed = -1, start;
+	int quiet = 0, opt, buttons;
+
+	while((opt = getopt(argc, argv, "s:n:x:e:o:T:q")) != -1){
+		switch(opt){
+			case 's': script_path = optarg; break;
+			case 'n': stop = strtoul(optarg, NULL, 10); break;
+			case 'x': speed = atof(optarg); break;
+			case 'e': every = strtoul(optarg, NULL, 10); break;
+			case 'o': png_dir = optarg; break;
+			case 'T':
+				if(!(SimTlmOut = fopen(optarg, "wb"))){
+					perror(optarg);
+					return 1;
+				}
+			break;
+			case 'q': quiet = 1; break;
+			default: Usage();
+		}
+	}
+	if(every == 0){
+		Usage();
+	}
+	if(script_path){
+		if(ScriptLoad(&script, script_path) < 0){
+			return 1;
+		}
+		if(!stop){
+			stop = script.end;
+		}
+		if(speed < 0){
+			speed = 0;
+		}
+	}
+	else{
+		if(!isatty(STDIN_FILENO)){
+			fprintf(stderr, "pingpong_sim: no script given and stdin is not a terminal\n");
+			return 1;
+		}
+		RawTerminal();
+		if(speed < 0){
+			speed = 1;
+		}
+	}
+	if(!quiet){
+		printf("\x1b[2J\x1b[?25l");
+	}
+
+	SimInit();
+	start = WallMs();
+	while(!stop || SimTime < stop){
+		buttons = script_path ? ScriptButtons(&script, SimTime) : ReadKeys(SimTime);
+		if(buttons < 0){
+			break;
+		}
+		if(!SimStep(buttons)){
+			continue;
+		}
+
+		if(!quiet && frame % every == 0){
+			DrawTerminal(&SimLast, SimTime);
+		}
+		if(png_dir){
+			DumpPng(&SimLast, png_dir, frame);
+		}
+		frame++;
+
+		// Hold back to the requested multiple of real time
+		if(speed > 0){
+			double ahead = SimTime / speed - (WallMs() - start);
+			if(ahead > 0){
+				usleep((useconds_t)(ahead * 1000));
+			}
+		}
+	}
+
+	if(SimTlmOut){
+		fclose(SimTlmOut);
+	}
+	if(quiet){
+		printf("%lu ms simulated, %lu frames in %.3f s\n", SimTime, frame, (WallMs() - start) / 1000.0);
+	}
+	return 0;
+}
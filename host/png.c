@@ -0,0 +1,119 @@
+// Minimal PNG writer, see png.h. Frames are tiny, so the image data goes into
+// stored (uncompressed) deflate blocks and no zlib is needed.
+#include <stdio.h>
+#include <stdlib.h>
+#include "png.h"
+
+static unsigned long crc_table[256];
+
+static unsigned long Crc(unsigned long crc, const unsigned char *data, size_t len)
+{
+	size_t n;
+	int k;
+
+	if(!crc_table[1]){
+		for(n = 0; n < 256; n++){
+			unsigned long c = n;
+			for(k = 0; k < 8; k++){
+				c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+			}
+			crc_table[n] = c;
+		}
+	}
+	crc ^= 0xFFFFFFFFUL;
+	for(n = 0; n < len; n++){
+		crc = crc_table[(crc ^ data[n]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFUL;
+}
+
+static void Put32(unsigned char *p, unsigned long v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void Chunk(FILE *out, const char *type, const unsigned char *data, size_t len)
+{
+	unsigned char head[8], tail[4];
+	unsigned long crc;
+
+	Put32(head, len);
+	head[4] = type[0]; head[5] = type[1]; head[6] = type[2]; head[7] = type[3];
+	crc = Crc(0, head + 4, 4);
+	crc = Crc(crc, data, len);
+	Put32(tail, crc);
+	fwrite(head, 1, 8, out);
+	fwrite(data, 1, len, out);
+	fwrite(tail, 1, 4, out);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Writes an RGB image as a PNG file
+//Parameter: Output path, size in pixels, width*height*3 bytes of RGB
+//Returns: 0 on success, -1 if the file could not be written
+int PngWrite(const char *path, int width, int height, const unsigned char *rgb)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	size_t stride = (size_t)width * 3 + 1; // Filter byte + row
+	size_t raw_len = stride * height;
+	size_t blocks = raw_len / 65535 + 1;
+	unsigned char *raw = malloc(raw_len);
+	unsigned char *z = malloc(2 + raw_len + blocks * 5 + 4);
+	unsigned char ihdr[13];
+	unsigned long a = 1, b = 0;
+	size_t n, pos, zlen = 0;
+	FILE *out;
+	int y;
+
+	for(y = 0; y < height; y++){
+		raw[y * stride] = 0; // Filter: none
+		for(n = 0; n < (size_t)width * 3; n++){
+			raw[y * stride + 1 + n] = rgb[(size_t)y * width * 3 + n];
+		}
+	}
+
+	// zlib stream of stored blocks followed by the Adler-32 of the raw data
+	z[zlen++] = 0x78;
+	z[zlen++] = 0x01;
+	for(pos = 0; ; pos += 65535){
+		size_t len = raw_len - pos < 65535 ? raw_len - pos : 65535;
+		z[zlen++] = pos + len >= raw_len; // BFINAL on the last block, BTYPE stored
+		z[zlen++] = len; z[zlen++] = len >> 8;
+		z[zlen++] = ~len; z[zlen++] = ~len >> 8;
+		for(n = 0; n < len; n++){
+			z[zlen++] = raw[pos + n];
+		}
+		if(pos + len >= raw_len){
+			break;
+		}
+	}
+	for(n = 0; n < raw_len; n++){
+		a = (a + raw[n]) % 65521;
+		b = (b + a) % 65521;
+	}
+	Put32(z + zlen, (b << 16) | a);
+	zlen += 4;
+
+	Put32(ihdr, width);
+	Put32(ihdr + 4, height);
+	ihdr[8] = 8;   // Bit depth
+	ihdr[9] = 2;   // Colour type: RGB
+	ihdr[10] = 0;  // Compression
+	ihdr[11] = 0;  // Filter
+	ihdr[12] = 0;  // Interlace
+
+	if(!(out = fopen(path, "wb"))){
+		perror(path);
+		free(raw);
+		free(z);
+		return -1;
+	}
+	fwrite(signature, 1, 8, out);
+	Chunk(out, "IHDR", ihdr, 13);
+	Chunk(out, "IDAT", z, zlen);
+	Chunk(out, "IEND", NULL, 0);
+	fclose(out);
+	free(raw);
+	free(z);
+	return 0;
+}
@@ -0,0 +1,7 @@
+// Minimal PNG writer for frame dumps: 8-bit RGB, uncompressed deflate blocks.
+#ifndef HOST_PNG_H
+#define HOST_PNG_H
+
+int PngWrite(const char *path, int width, int height, const unsigned char *rgb);
+
+#endif
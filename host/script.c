@@ -0,0 +1,131 @@
+// Scripted button input, see script.h for the file format.
+#include <stdlib.h>
+#include <string.h>
+#include "script.h"
+
+static const char button_letters[] = "LRSXlrAM";
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Turns button letters into a PINC-ordered mask
+//Parameter: Letters from button_letters, or "-"
+//Returns: The mask, or -1 on an unknown letter
+int ScriptParseButtons(const char *text)
+{
+	int mask = 0;
+	const char *p;
+
+	if(strcmp(text, "-") == 0){
+		return 0;
+	}
+	for(; *text; text++){
+		if(!(p = strchr(button_letters, *text))){
+			return -1;
+		}
+		mask |= 1 << (p - button_letters);
+	}
+	return mask;
+}
+
+void ScriptFormatButtons(unsigned char buttons, char *text)
+{
+	int n;
+
+	for(n = 0; button_letters[n]; n++){
+		if(buttons & (1 << n)){
+			*text++ = button_letters[n];
+		}
+	}
+	if(!buttons){
+		*text++ = '-';
+	}
+	*text = 0;
+}
+
+void ScriptAdd(Script *s, unsigned long time, unsigned char buttons)
+{
+	s->steps = realloc(s->steps, (s->count + 1) * sizeof(ScriptStep));
+	s->steps[s->count].time = time;
+	s->steps[s->count].buttons = buttons;
+	s->count++;
+	if(time > s->end){
+		s->end = time;
+	}
+}
+
+int ScriptParse(Script *s, FILE *in, const char *name)
+{
+	char line[256], buttons[64];
+	unsigned long time;
+	int lineno = 0;
+	int mask;
+
+	memset(s, 0, sizeof(*s));
+	while(fgets(line, sizeof(line), in)){
+		lineno++;
+		if(line[strspn(line, " \t\r\n")] == '#' || line[strspn(line, " \t\r\n")] == 0){
+			continue;
+		}
+		if(sscanf(line, "%lu %63s", &time, buttons) != 2){
+			fprintf(stderr, "%s:%d: expected \"<ms> <buttons>\"\n", name, lineno);
+			return -1;
+		}
+		if(s->count && time < s->steps[s->count - 1].time){
+			fprintf(stderr, "%s:%d: time goes backwards\n", name, lineno);
+			return -1;
+		}
+		if(strcmp(buttons, "end") == 0){
+			s->end = time;
+			break;
+		}
+		if((mask = ScriptParseButtons(buttons)) < 0){
+			fprintf(stderr, "%s:%d: unknown button in \"%s\" (use %s or -)\n", name, lineno, buttons, button_letters);
+			return -1;
+		}
+		ScriptAdd(s, time, mask);
+	}
+	return 0;
+}
+
+int ScriptLoad(Script *s, const char *path)
+{
+	FILE *in = fopen(path, "r");
+	int result;
+
+	if(!in){
+		perror(path);
+		return -1;
+	}
+	result = ScriptParse(s, in, path);
+	fclose(in);
+	return result;
+}
+
+void ScriptFree(Script *s)
+{
+	free(s->steps);
+	memset(s, 0, sizeof(*s));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Looks up the buttons held at a given time
+//Parameter: The script and the time in ms; time must not go backwards between calls
+//Returns: The PINC-ordered button mask
+unsigned char ScriptButtons(Script *s, unsigned long time)
+{
+	while(s->cursor < s->count && s->steps[s->cursor].time <= time){
+		s->cursor++;
+	}
+	return s->cursor ? s->steps[s->cursor - 1].buttons : 0;
+}
+
+void ScriptWrite(const Script *s, FILE *out)
+{
+	char text[16];
+	int n;
+
+	for(n = 0; n < s->count; n++){
+		ScriptFormatButtons(s->steps[n].buttons, text);
+		fprintf(out, "%lu %s\n", s->steps[n].time, text);
+	}
+	fprintf(out, "%lu end\n", s->end);
+}
@@ -0,0 +1,39 @@
+// Scripted button input for the host tools.
+//
+//	# comment
+//	0     -        no buttons
+//	500   S        hold Start from 500 ms
+//	600   L        release Start, hold player-left
+//	900   lA       enemy-left and the Autonomous toggle together
+//	5000  end      optional, stop here
+//
+// Each line holds its buttons until the next line. Button letters follow
+// PINC: L R S X(restart) l r(enemy paddle) A(autonomous) M(game mode),
+// "-" for none.
+#ifndef HOST_SCRIPT_H
+#define HOST_SCRIPT_H
+
+#include <stdio.h>
+
+typedef struct {
+	unsigned long time;    // ms
+	unsigned char buttons; // PINC bit order, 1 = pressed
+} ScriptStep;
+
+typedef struct {
+	ScriptStep *steps;
+	int count;
+	unsigned long end;     // ms, from "end" or last step time
+	int cursor;            // Used by ScriptButtons
+} Script;
+
+int ScriptLoad(Script *s, const char *path);
+int ScriptParse(Script *s, FILE *in, const char *name);
+void ScriptFree(Script *s);
+void ScriptAdd(Script *s, unsigned long time, unsigned char buttons);
+unsigned char ScriptButtons(Script *s, unsigned long time);
+void ScriptWrite(const Script *s, FILE *out);
+int ScriptParseButtons(const char *text);
+void ScriptFormatButtons(unsigned char buttons, char *text);
+
+#endif
@@ -0,0 +1,178 @@
+// Host simulator core, see sim.h.
+#include <stdlib.h>
+#include <string.h>
+#include "avr/interrupt.h"
+#include "game.h"
+#include "sim.h"
+#include "state.h"
+
+unsigned long SimTime = 0;
+SimFrame SimLast;
+FILE *SimTlmOut = NULL;
+#if DISPLAY_SPI
+Max7219Chain SimPanel;
+#endif
+
+static SimFrame acc;
+static unsigned int tlm_credit; // USART0 bytes owed, in hundredths
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Powers the game up the way main() does, from the same
+//                power-on values every time so one process can run many games
+//Parameter: None
+//Returns: Nothing
+void SimInit(void)
+{
+	static unsigned char *power_on = NULL;
+
+	if(!power_on){
+		power_on = malloc(StateSize());
+		StateSave(power_on);
+	}
+	else{
+		StateLoad(power_on);
+	}
+
+	DDRA = 0xFF; PORTA = 0x00;
+	DDRB = 0xFF; PORTB = 0x00;
+	DDRC = 0x00; PORTC = 0xFF;
+	DDRD = 0xFF; PORTD = 0x00;
+	PORTA = 0xFF;
+	PINC = 0xFF;
+
+	SchedulerInit();
+	TlmOn();
+#if DISPLAY_SPI
+	Max7219Init(&SimPanel, PANEL_MODULES_X, PANEL_MODULES_Y);
+	PanelOn();
+#endif
+
+	SimTime = 0;
+	tlm_credit = 0;
+	memset(&acc, 0, sizeof(acc));
+	memset(&SimLast, 0, sizeof(SimLast));
+}
+
+#if DISPLAY_SPI
+// At 4 MHz whatever was queued is out in well under a millisecond
+static void SpiDrain(void)
+{
+	while(SpiBusy){
+		unsigned char load = PORTB & 0x10;
+		Max7219Byte(&SimPanel, SPDR);
+		SPI_STC_vect();
+		if(!load && (PORTB & 0x10)){
+			Max7219Latch(&SimPanel);
+		}
+	}
+}
+#else
+#define SpiDrain()
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one scheduler tick (1 ms) with the given buttons held
+//Parameter: Buttons in PINC bit order, 1 = pressed
+//Returns: 1 when this millisecond completed a frame (now in SimLast), else 0
+int SimStep(unsigned char buttons)
+{
+	int row, col;
+
+	PINC = ~buttons;
+	// In power-down (SE set) nothing runs until a button changes a PORTC pin
+	if((SMCR & 0x01) && buttons){
+		PCINT2_vect();
+		PowerWake();
+		SpiDrain();
+	}
+	if(!(SMCR & 0x01)){
+		// The main loop of main.c
+		SchedulerTick();
+		TimerFlag = 0;
+		PowerTick();
+		if(PowerDown){
+			PowerDownEnter();
+		}
+		SpiDrain();
+	}
+
+	// Whatever the tick left on the ports stays lit until the next tick
+	for(row = 0; row < BOARD_HEIGHT; row++){
+		if(!(MATRIX_ROWS & ROW(row))){
+			for(col = 0; col < BOARD_WIDTH; col++){
+				if(MATRIX_COLS & COLUMN(col)){
+					acc.pixel[row][col]++;
+				}
+			}
+		}
+	}
+	for(col = 0; col < 8; col++){
+		if(PORTD & (1 << col)){
+			acc.led[col]++;
+		}
+	}
+
+	// 38400 baud 8N1 moves 3.84 bytes per ms, none in power-down
+	for(tlm_credit += 384; tlm_credit >= 100 && (UCSR0B & 0x20) && !(SMCR & 0x01); tlm_credit -= 100){
+		unsigned char tail = TlmTail;
+		USART0_UDRE_vect();
+		if(SimTlmOut && tail != TlmTail){
+			fputc(UDR0, SimTlmOut);
+		}
+	}
+	if(tlm_credit >= 100){
+		tlm_credit = 100; // An idle line does not bank time
+	}
+
+	SimTime++;
+	if(SimTime % SIM_FRAME_MS == 0){
+		SimLast = acc;
+		memset(&acc, 0, sizeof(acc));
+		return 1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Size of a SimSave snapshot
+//Parameter: None
+//Returns: Bytes
+size_t SimStateSize(void)
+{
+	size_t size = StateSize() + sizeof(SimTime) + sizeof(tlm_credit) + sizeof(acc) + sizeof(SimLast);
+#if DISPLAY_SPI
+	size += sizeof(SimPanel);
+#endif
+	return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Snapshots everything a later SimStep depends on, so that
+//                SimLoad and the same buttons replay it exactly
+//Parameter: Where to put it, SimStateSize bytes
+//Returns: Nothing
+void SimSave(unsigned char *buf)
+{
+	StateSave(buf);
+	buf += StateSize();
+	memcpy(buf, &SimTime, sizeof(SimTime)); buf += sizeof(SimTime);
+	memcpy(buf, &tlm_credit, sizeof(tlm_credit)); buf += sizeof(tlm_credit);
+	memcpy(buf, &acc, sizeof(acc)); buf += sizeof(acc);
+	memcpy(buf, &SimLast, sizeof(SimLast)); buf += sizeof(SimLast);
+#if DISPLAY_SPI
+	memcpy(buf, &SimPanel, sizeof(SimPanel));
+#endif
+}
+
+void SimLoad(const unsigned char *buf)
+{
+	StateLoad(buf);
+	buf += StateSize();
+	memcpy(&SimTime, buf, sizeof(SimTime)); buf += sizeof(SimTime);
+	memcpy(&tlm_credit, buf, sizeof(tlm_credit)); buf += sizeof(tlm_credit);
+	memcpy(&acc, buf, sizeof(acc)); buf += sizeof(acc);
+	memcpy(&SimLast, buf, sizeof(SimLast)); buf += sizeof(SimLast);
+#if DISPLAY_SPI
+	memcpy(&SimPanel, buf, sizeof(SimPanel));
+#endif
+}
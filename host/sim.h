@@ -0,0 +1,46 @@
+// Host simulator core: runs main.c's scheduler one millisecond at a time and
+// integrates the PORTA/PORTB matrix and PORTD LEDs over each display frame,
+// the way persistence of vision does on the real multiplexed panel.
+// Built with -DDISPLAY_SPI=1 it integrates MatrixCols/MatrixRows instead and
+// also runs the bytes main.c sends over SPI into a MAX7219 chain (SimPanel).
+// Each step also does what the main loop of main.c does after a tick
+// (PowerTick, power-down); while the CPU sleeps only a button wakes it.
+// SimSave/SimLoad snapshot the whole simulation: main.c (the state.c
+// registry) plus the frame being integrated here.
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdio.h>
+#include "game.h"
+#include "max7219.h"
+
+// Buttons in PINC bit order, active high here (the pins themselves are active low)
+#define BTN_LEFT      0x01 // Player paddle left
+#define BTN_RIGHT     0x02 // Player paddle right
+#define BTN_START     0x04
+#define BTN_RESTART   0x08
+#define BTN_E_LEFT    0x10 // Enemy paddle left
+#define BTN_E_RIGHT   0x20 // Enemy paddle right
+#define BTN_AUTO      0x40 // Autonomous AI toggle
+#define BTN_MODE      0x80 // Game mode, in idle only
+
+// 15 ms is five full PlayerOutput/BallOutput/EnemyOutput scans, about 67 fps
+#define SIM_FRAME_MS 15
+
+typedef struct {
+	unsigned char pixel[BOARD_HEIGHT][BOARD_WIDTH]; // ms each matrix LED was on, [row][column], row 0 is the player side
+	unsigned char led[8];      // ms each PORTD LED was on, [bit]
+} SimFrame;
+
+extern unsigned long SimTime;  // ms since SimInit
+extern SimFrame SimLast;       // Last completed frame
+extern FILE *SimTlmOut;        // If set, telemetry bytes sent by USART0 are written here
+extern Max7219Chain SimPanel;  // DISPLAY_SPI builds only: what the panel shows, updated as LOAD latches
+
+void SimInit(void);
+int SimStep(unsigned char buttons);
+size_t SimStateSize(void);
+void SimSave(unsigned char *buf);
+void SimLoad(const unsigned char *buf);
+
+#endif
@@ -0,0 +1,129 @@
+// State registry, see state.h.
+#include <stdint.h>
+#include <string.h>
+#include "avr/interrupt.h"
+#include "game.h"
+#include "state.h"
+
+#define VAR(v) { #v, &(v), sizeof(v) }
+#define MAX_VARS 96
+
+static StateVar vars[MAX_VARS];
+static int var_count = 0;
+static size_t total_size = 0;
+
+static void Add(const char *name, volatile void *addr, size_t size)
+{
+	vars[var_count].name = name;
+	vars[var_count].addr = addr;
+	vars[var_count].size = size;
+	var_count++;
+	total_size += size;
+}
+
+// Task structs are static in main.c, so they are reached through tasks[] at run time
+static void Build(void)
+{
+	static const char *task_names[][3] = {
+		{ "task0.state", "task0.period", "task0.elapsedTime" },
+		{ "task1.state", "task1.period", "task1.elapsedTime" },
+		{ "task2.state", "task2.period", "task2.elapsedTime" },
+		{ "task3.state", "task3.period", "task3.elapsedTime" },
+	};
+	static const StateVar fixed[] = {
+		VAR(PlayerPaddlePosition), VAR(EnemyPaddlePosition),
+		VAR(PlayerScore), VAR(EnemyScore),
+		VAR(Autonomous),
+		VAR(indexXpos), VAR(i), VAR(AIdumbifier), VAR(Attract), VAR(IdleTime),
+		VAR(Field), VAR(Entities), VAR(GameMode), VAR(ModeHeld), VAR(DrawIndex),
+		VAR(GCD), VAR(TimerFlag), VAR(_avr_timer_M), VAR(_avr_timer_cntcurr),
+		VAR(TlmBuf), VAR(TlmHead), VAR(TlmTail), VAR(TlmDropped), VAR(TlmTime),
+		VAR(TlmPlayerPaddle), VAR(TlmEnemyPaddle),
+		VAR(PORTA), VAR(PORTB), VAR(PORTC), VAR(PORTD), VAR(PINC),
+		VAR(UCSR0B), VAR(UDR0), VAR(SREG),
+		VAR(TextRows), VAR(TextPos), VAR(TextColumn), VAR(TextTail), VAR(TextTime), VAR(TextRow), VAR(TextActive), VAR(StackFree),
+		VAR(SavedGame), VAR(PowerDown), VAR(PCICR), VAR(PCIFR), VAR(PCMSK2), VAR(SMCR), VAR(TCNT1),
+#if DISPLAY_SPI
+		VAR(MatrixCols), VAR(MatrixRows), VAR(PanelAcc), VAR(PanelTime), VAR(PanelDropped),
+		VAR(SpiOut), VAR(SpiIndex), VAR(SpiCount), VAR(SpiBusy),
+		VAR(SPCR), VAR(SPSR), VAR(SPDR),
+#endif
+	};
+	unsigned short t;
+	size_t n;
+
+	for(n = 0; n < sizeof(fixed) / sizeof(fixed[0]); n++){
+		Add(fixed[n].name, fixed[n].addr, fixed[n].size);
+	}
+	for(t = 0; t < numTasks && t < 4; t++){
+		Add(task_names[t][0], &tasks[t]->state, sizeof(tasks[t]->state));
+		Add(task_names[t][1], &tasks[t]->period, sizeof(tasks[t]->period));
+		Add(task_names[t][2], &tasks[t]->elapsedTime, sizeof(tasks[t]->elapsedTime));
+	}
+}
+
+const StateVar *StateVars(int *count)
+{
+	if(!var_count){
+		Build();
+	}
+	*count = var_count;
+	return vars;
+}
+
+size_t StateSize(void)
+{
+	int count;
+	StateVars(&count);
+	return total_size;
+}
+
+void StateSave(unsigned char *buf)
+{
+	int count, n;
+	const StateVar *v = StateVars(&count);
+
+	for(n = 0; n < count; n++){
+		memcpy(buf, (const void *)v[n].addr, v[n].size);
+		buf += v[n].size;
+	}
+}
+
+void StateLoad(const unsigned char *buf)
+{
+	int count, n;
+	const StateVar *v = StateVars(&count);
+
+	for(n = 0; n < count; n++){
+		memcpy((void *)v[n].addr, buf, v[n].size);
+		buf += v[n].size;
+	}
+}
+
+const StateVar *StateFind(const char *name)
+{
+	int count, n;
+	const StateVar *v = StateVars(&count);
+
+	for(n = 0; n < count; n++){
+		if(strcmp(v[n].name, name) == 0){
+			return &v[n];
+		}
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Reads a registered scalar
+//Parameter: The registry entry
+//Returns: Its value; arrays read as their first element
+unsigned long StateRead(const StateVar *v)
+{
+	switch(v->size){
+		case 1: return *(volatile unsigned char *)v->addr;
+		case 2: return *(volatile uint16_t *)v->addr;
+		case 4: return *(volatile uint32_t *)v->addr;
+		case 8: return *(volatile uint64_t *)v->addr;
+		default: return *(volatile unsigned char *)v->addr;
+	}
+}
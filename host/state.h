@@ -0,0 +1,22 @@
+// Registry of every piece of mutable state in main.c plus the I/O registers it
+// touches, so the host tools can snapshot, restore and inspect the whole game.
+// A variable added to main.c has to be added to state.c as well.
+#ifndef HOST_STATE_H
+#define HOST_STATE_H
+
+#include <stddef.h>
+
+typedef struct {
+	const char *name;
+	volatile void *addr;
+	size_t size;
+} StateVar;
+
+const StateVar *StateVars(int *count);
+size_t StateSize(void);
+void StateSave(unsigned char *buf);
+void StateLoad(const unsigned char *buf);
+const StateVar *StateFind(const char *name);
+unsigned long StateRead(const StateVar *v);
+
+#endif
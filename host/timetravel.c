@@ -0,0 +1,545 @@
+// Time-travel debugger for the host build. Plays a button script through the
+// real main.c and keeps a snapshot of the whole simulation (SimSave: the task
+// array, every shared global and I/O register of the state.c registry, and
+// the frame being integrated) every N ticks. Any tick is then at most N-1
+// replayed ticks away from a snapshot, forwards or backwards, and breakpoints
+// stop a run, or a run backwards, on the tick a condition turns true.
+//
+// Build: gcc -O2 -DHOST_BUILD -Ihost -o timetravel main.c host/avr_host.c
+//            host/sim.c host/state.c host/script.c host/timetravel.c
+//
+// Use:   ./timetravel -s match.scn                     commands from the terminal
+//        ./timetravel -s match.scn -i 250 < commands   snapshot every 250 ticks
+//        ./timetravel -s match.scn -e "break BallXPosition becomes 0" -e run -e print
+//
+// A tick is one scheduler millisecond; "tick t" is the state after t of them.
+// Commands:
+//	run, c               forward to the next breakpoint or the end (-n)
+//	step [n], s          forward n ticks (1)
+//	back [n], b          backward n ticks (1)
+//	reverse, rc          backward to the last tick a breakpoint was hit
+//	seek <tick>, g       to any tick
+//	break <condition>    stop on the tick it turns true:
+//	    <var> becomes <n>  e.g. BallXPosition becomes 0
+//	    <var> changes      e.g. PlayerScore changes
+//	    enters <state>     a task enters a state of main.c, e.g. enters Ball_Bounce
+//	delete [n]           breakpoint n, or all of them
+//	print [var]..., p    the variables, or an overview of the game
+//	board                the last 15 ms frame of the matrix and the LEDs
+//	info                 breakpoints and snapshots
+//	quit, q
+// Variables are the names of the state.c registry (PlayerScore, task1.state,
+// TlmHead...), the Entities[0] names of game.h (BallXPosition...) and the
+// task names, which stand for their state (SMBall).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "avr/interrupt.h"
+#include "game.h"
+#include "script.h"
+#include "sim.h"
+#include "state.h"
+
+#define SNAPSHOT_TICKS 1000     // Default -i
+#define DEFAULT_END 600000UL    // run stops here without a script, 10 minutes
+#define MAX_BREAKPOINTS 16
+#define MAX_COMMANDS 32
+#define MAX_WORDS 8
+
+enum Break_Kinds { Brk_becomes, Brk_changes };
+
+typedef struct {
+	int kind;
+	StateVar var;           // What it watches
+	unsigned long value;    // Brk_becomes: the value
+	unsigned long before;   // Value at the previous tick
+	char text[96];          // As typed, for the reports
+} Breakpoint;
+
+static const char *task_names[] = { "SMDisplay", "SMBall", "SMPlayerPaddle", "SMEnemyPaddle" };
+static const char *state_names[4][8] = {
+	{ "Disp_init", "Disp_start", "Disp_startSequence", "PlayerOutput", "BallOutput", "EnemyOutput", "PWinState", "EnemyWinState" },
+	{ "Ball_init", "Ball_start", "idle", "Ball_Moving", "Ball_Bounce" },
+	{ "Paddle_init", "Paddle_start", "Paddle_idle", "Paddle_press", "Paddle_release", "auto_function_press", "auto_function_release" },
+	{ "EnemyPaddle_init", "EnemyPaddle_start", "EnemyPaddle_idle", "EnemyPaddle_press", "EnemyPaddle_release" },
+};
+
+// The Entities[0] macros of game.h are not in the registry under these names
+static const StateVar aliases[] = {
+	{ "BallXPosition", &BallXPosition, sizeof(BallXPosition) },
+	{ "BallYPosition", &BallYPosition, sizeof(BallYPosition) },
+	{ "ball_xMove_left", &ball_xMove_left, sizeof(ball_xMove_left) },
+	{ "ball_xMove_right", &ball_xMove_right, sizeof(ball_xMove_right) },
+	{ "ball_yMove_up", &ball_yMove_up, sizeof(ball_yMove_up) },
+	{ "ball_yMove_down", &ball_yMove_down, sizeof(ball_yMove_down) },
+};
+
+static Script script;
+static int have_script = 0;
+static unsigned long end = DEFAULT_END;
+
+// Snapshot k holds tick k * every; all of them up to the furthest tick reached so far exist
+static unsigned long every = SNAPSHOT_TICKS;
+static unsigned char *snapshots = NULL;
+static unsigned long snapshot_count = 0;
+static size_t snapshot_size;
+
+static Breakpoint breaks[MAX_BREAKPOINTS];
+static int break_count = 0;
+
+//--------Timeline------------------------------------------------------------
+static unsigned char Buttons(void)
+{
+	return have_script ? ScriptButtons(&script, SimTime) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one tick forward, taking the snapshot when it reaches
+//                a new multiple of every
+//Parameter: None
+//Returns: Nothing
+static void Tick(void)
+{
+	SimStep(Buttons());
+	if(SimTime % every == 0 && SimTime / every == snapshot_count){
+		snapshots = realloc(snapshots, (snapshot_count + 1) * snapshot_size);
+		SimSave(snapshots + snapshot_count * snapshot_size);
+		snapshot_count++;
+	}
+}
+
+// Breakpoints compare with the tick before, so they start again from here
+static void Arm(void)
+{
+	int n;
+
+	for(n = 0; n < break_count; n++){
+		breaks[n].before = StateRead(&breaks[n].var);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Moves to a tick from the nearest snapshot at or before it,
+//                or from where the simulation is if that is nearer
+//Parameter: The tick
+//Returns: Nothing
+static void Seek(unsigned long tick)
+{
+	unsigned long k = tick / every;
+
+	if(k >= snapshot_count){
+		k = snapshot_count - 1;
+	}
+	if(tick < SimTime || k * every > SimTime){
+		SimLoad(snapshots + k * snapshot_size);
+		script.cursor = 0;
+	}
+	while(SimTime < tick){
+		Tick();
+	}
+	Arm();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Checks the breakpoints after a tick
+//Parameter: None
+//Returns: The first one hit, or -1
+static int Hit(void)
+{
+	unsigned long now;
+	int n, hit = -1;
+
+	for(n = 0; n < break_count; n++){
+		now = StateRead(&breaks[n].var);
+		if(hit < 0 && now != breaks[n].before
+				&& (breaks[n].kind == Brk_changes || now == breaks[n].value)){
+			hit = n;
+		}
+		breaks[n].before = now;
+	}
+	return hit;
+}
+
+static void Report(int n)
+{
+	printf("breakpoint %d, tick %lu: %s\n", n + 1, SimTime, breaks[n].text);
+}
+
+// Forward count ticks, or less when a breakpoint is hit
+static void Run(unsigned long count)
+{
+	int hit;
+
+	while(count--){
+		Tick();
+		if((hit = Hit()) >= 0){
+			Report(hit);
+			return;
+		}
+	}
+	printf("tick %lu\n", SimTime);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Goes back to the last tick before this one that hit a
+//                breakpoint, replaying one snapshot interval at a time
+//Parameter: None
+//Returns: Nothing
+static void Reverse(void)
+{
+	unsigned long start, last = SimTime, found = 0, until = SimTime;
+	int hit, found_hit = -1;
+
+	while(found_hit < 0 && last > 0){
+		// Ticks start+1 .. last are the ones a replay from start can hit on
+		start = (last - 1) / every * every;
+		Seek(start);
+		while(SimTime < last){
+			Tick();
+			if((hit = Hit()) >= 0 && SimTime < until){
+				found = SimTime;
+				found_hit = hit;
+			}
+		}
+		last = start;
+	}
+	if(found_hit < 0){
+		Seek(0);
+		printf("no breakpoint hit before tick %lu, at tick 0\n", until);
+		return;
+	}
+	Seek(found);
+	Report(found_hit);
+}
+//--------End Timeline--------------------------------------------------------
+
+//--------Variables-----------------------------------------------------------
+static int FindVar(const char *name, StateVar *var)
+{
+	char task_var[16];
+	const StateVar *v;
+	size_t n;
+
+	for(n = 0; n < sizeof(aliases) / sizeof(aliases[0]); n++){
+		if(strcmp(aliases[n].name, name) == 0){
+			*var = aliases[n];
+			return 0;
+		}
+	}
+	for(n = 0; n < 4; n++){
+		if(strcmp(task_names[n], name) == 0){
+			snprintf(task_var, sizeof(task_var), "task%d.state", (int)n);
+			name = task_var;
+		}
+	}
+	if(!(v = StateFind(name))){
+		return -1;
+	}
+	*var = *v;
+	var->name = name == task_var ? task_names[task_var[4] - '0'] : v->name;
+	return 0;
+}
+
+// A state name of main.c, as the task whose state it is and its value
+static int FindState(const char *name, int *task, int *value)
+{
+	int t, n;
+
+	for(t = 0; t < 4; t++){
+		for(n = 0; n < 8 && state_names[t][n]; n++){
+			if(strcmp(state_names[t][n], name) == 0){
+				*task = t;
+				*value = n;
+				return 0;
+			}
+		}
+	}
+	return -1;
+}
+
+static void PrintVar(const StateVar *v)
+{
+	const volatile unsigned char *p = v->addr;
+	size_t n;
+
+	printf("%s =", v->name);
+	if(v->size == 1 || v->size == 2 || v->size == 4 || v->size == 8){
+		printf(" %lu (0x%lx)\n", StateRead(v), StateRead(v));
+		return;
+	}
+	for(n = 0; n < v->size; n++){
+		printf(" %02x", p[n]);
+	}
+	printf("\n");
+}
+
+static const char *StateName(int task)
+{
+	signed char state = tasks[task]->state;
+
+	if(state < 0 || state >= 8 || !state_names[task][state]){
+		return "?";
+	}
+	return state_names[task][state];
+}
+
+static void Overview(void)
+{
+	char held[16];
+	int t;
+
+	ScriptFormatButtons(Buttons(), held);
+	printf("tick %lu, buttons %s%s\n", SimTime, held, (SMCR & 0x01) ? ", asleep" : "");
+	for(t = 0; t < numTasks && t < 4; t++){
+		printf("  %-15s %-22s elapsed %lu/%lu\n", task_names[t], StateName(t),
+			tasks[t]->elapsedTime, tasks[t]->period);
+	}
+	printf("  ball %u,%u moving %s%s%s%s, paddles %u/%u, score %u:%u\n",
+		BallXPosition, BallYPosition,
+		ball_xMove_left ? "left" : "", ball_xMove_right ? "right" : "",
+		ball_yMove_up ? " up" : "", ball_yMove_down ? " down" : "",
+		PlayerPaddlePosition, EnemyPaddlePosition, PlayerScore, EnemyScore);
+	printf("  mode %u, autonomous %u, attract %u, idle %lu ms\n", GameMode, Autonomous, Attract, IdleTime);
+}
+
+static void Board(void)
+{
+	int row, col;
+
+	for(row = TOP_ROW; row >= 0; row--){
+		printf("  ");
+		for(col = LEFT_COLUMN; col >= 0; col--){
+			putchar(SimLast.pixel[row][col] ? '#' : '.');
+		}
+		printf("\n");
+	}
+	printf("  ");
+	for(col = 7; col >= 0; col--){
+		putchar(SimLast.led[col] ? 'o' : '.');
+	}
+	printf("  PORTD\n");
+}
+//--------End Variables-------------------------------------------------------
+
+//--------Commands------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Parses "break ..." into a new breakpoint
+//Parameter: The words after break, and how many
+//Returns: 0, or -1 after printing what is wrong
+static int Break(char **word, int words)
+{
+	Breakpoint *b = &breaks[break_count];
+	int task, value, n;
+	char *rest;
+
+	if(break_count == MAX_BREAKPOINTS){
+		printf("at most %d breakpoints\n", MAX_BREAKPOINTS);
+		return -1;
+	}
+	memset(b, 0, sizeof(*b));
+	if(words == 2 && strcmp(word[0], "enters") == 0){
+		if(FindState(word[1], &task, &value) < 0){
+			printf("no state %s in main.c\n", word[1]);
+			return -1;
+		}
+		FindVar(task_names[task], &b->var);
+		b->kind = Brk_becomes;
+		b->value = value;
+	}
+	else if(words >= 2 && FindVar(word[0], &b->var) < 0){
+		printf("no variable %s\n", word[0]);
+		return -1;
+	}
+	else if(words == 2 && strcmp(word[1], "changes") == 0){
+		b->kind = Brk_changes;
+	}
+	else if(words == 3 && strcmp(word[1], "becomes") == 0){
+		b->kind = Brk_becomes;
+		b->value = strtoul(word[2], &rest, 0);
+		if(*rest && FindState(word[2], &task, &value) == 0){
+			b->value = value;
+		}
+		else if(*rest){
+			printf("not a number or state: %s\n", word[2]);
+			return -1;
+		}
+	}
+	else{
+		printf("break <var> becomes <n> | break <var> changes | break enters <state>\n");
+		return -1;
+	}
+	for(n = 0; n < words; n++){
+		snprintf(b->text + strlen(b->text), sizeof(b->text) - strlen(b->text), "%s%s", n ? " " : "", word[n]);
+	}
+	b->before = StateRead(&b->var);
+	break_count++;
+	printf("breakpoint %d: %s\n", break_count, b->text);
+	return 0;
+}
+
+static void Info(void)
+{
+	int n;
+
+	printf("tick %lu, end %lu\n", SimTime, end);
+	printf("%lu snapshots every %lu ticks, %lu bytes each, up to tick %lu\n",
+		snapshot_count, every, (unsigned long)snapshot_size, (snapshot_count - 1) * every);
+	for(n = 0; n < break_count; n++){
+		printf("breakpoint %d: %s\n", n + 1, breaks[n].text);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one command line
+//Parameter: The line, changed in place
+//Returns: 1 on quit, else 0
+static int Command(char *line)
+{
+	char *word[MAX_WORDS], *cmd;
+	unsigned long count;
+	StateVar var;
+	int words = 0, n;
+
+	for(cmd = strtok(line, " \t\r\n"); cmd && words < MAX_WORDS; cmd = strtok(NULL, " \t\r\n")){
+		word[words++] = cmd;
+	}
+	if(!words || word[0][0] == '#'){
+		return 0;
+	}
+	cmd = word[0];
+	count = words > 1 ? strtoul(word[1], NULL, 0) : 1;
+
+	if(!strcmp(cmd, "run") || !strcmp(cmd, "c") || !strcmp(cmd, "continue")){
+		Run(SimTime < end ? end - SimTime : 0);
+	}
+	else if(!strcmp(cmd, "step") || !strcmp(cmd, "s")){
+		Run(count);
+	}
+	else if(!strcmp(cmd, "back") || !strcmp(cmd, "b")){
+		Seek(count < SimTime ? SimTime - count : 0);
+		printf("tick %lu\n", SimTime);
+	}
+	else if(!strcmp(cmd, "reverse") || !strcmp(cmd, "rc")){
+		Reverse();
+	}
+	else if((!strcmp(cmd, "seek") || !strcmp(cmd, "g")) && words == 2){
+		Seek(count);
+		printf("tick %lu\n", SimTime);
+	}
+	else if(!strcmp(cmd, "break")){
+		Break(word + 1, words - 1);
+	}
+	else if(!strcmp(cmd, "delete")){
+		if(words == 1){
+			break_count = 0;
+		}
+		else if(count >= 1 && count <= (unsigned long)break_count){
+			memmove(&breaks[count - 1], &breaks[count], (break_count - count) * sizeof(Breakpoint));
+			break_count--;
+		}
+		else{
+			printf("no breakpoint %s\n", word[1]);
+		}
+	}
+	else if(!strcmp(cmd, "print") || !strcmp(cmd, "p")){
+		if(words == 1){
+			Overview();
+		}
+		for(n = 1; n < words; n++){
+			if(FindVar(word[n], &var) < 0){
+				printf("no variable %s\n", word[n]);
+			}
+			else{
+				PrintVar(&var);
+			}
+		}
+	}
+	else if(!strcmp(cmd, "board")){
+		Board();
+	}
+	else if(!strcmp(cmd, "info")){
+		Info();
+	}
+	else if(!strcmp(cmd, "quit") || !strcmp(cmd, "q")){
+		return 1;
+	}
+	else{
+		printf("unknown command %s (run step back reverse seek break delete print board info quit)\n", cmd);
+	}
+	fflush(stdout);
+	return 0;
+}
+//--------End Commands--------------------------------------------------------
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: timetravel [-s script] [-n ms] [-i ticks] [-e command]...\n"
+		"  -s  buttons from a script (default: none pressed)\n"
+		"  -n  where run stops (default: end of script, or 10 minutes)\n"
+		"  -i  ticks between snapshots (default %d)\n"
+		"  -e  run a command before reading more from stdin, may be repeated\n", SNAPSHOT_TICKS);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	char *commands[MAX_COMMANDS], line[256];
+	int command_count = 0, opt, n, tty = isatty(STDIN_FILENO);
+	unsigned long stop = 0;
+
+	while((opt = getopt(argc, argv, "s:n:i:e:")) != -1){
+		switch(opt){
+			case 's':
+				if(ScriptLoad(&script, optarg) < 0){
+					return 1;
+				}
+				have_script = 1;
+			break;
+			case 'n': stop = strtoul(optarg, NULL, 10); break;
+			case 'i': every = strtoul(optarg, NULL, 10); break;
+			case 'e':
+				if(command_count == MAX_COMMANDS){
+					Usage();
+				}
+				commands[command_count++] = optarg;
+			break;
+			default: Usage();
+		}
+	}
+	if(every == 0 || optind != argc){
+		Usage();
+	}
+	if(stop){
+		end = stop;
+	}
+	else if(have_script){
+		end = script.end;
+	}
+
+	SimInit();
+	snapshot_size = SimStateSize();
+	snapshots = malloc(snapshot_size);
+	SimSave(snapshots);
+	snapshot_count = 1;
+
+	for(n = 0; n < command_count; n++){
+		snprintf(line, sizeof(line), "%s", commands[n]);
+		if(tty || command_count > 1){
+			printf("(timetravel) %s\n", commands[n]);
+		}
+		if(Command(line)){
+			return 0;
+		}
+	}
+	for(;;){
+		if(tty){
+			printf("(timetravel) ");
+			fflush(stdout);
+		}
+		if(!fgets(line, sizeof(line), stdin) || Command(line)){
+			break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+// Host-side decoder for the telemetry stream sent on USART0 by main.c.
+// Reads the raw bytes from a file (or stdin) and prints one line per event:
+//
+//	   12.345 s  ball     x=3 y=1 dir=left/up
+//
+// Build: gcc -O2 -o tlm_decode host/tlm_decode.c
+// Use:   stty -F /dev/ttyUSB0 38400 raw && ./tlm_decode /dev/ttyUSB0
+//        ./tlm_decode -c capture.bin > timeline.csv
+#include <stdio.h>
+#include <string.h>
+
+// Must match enum Tlm_Events in main.c
+enum Tlm_Events { Tlm_ball = 1, Tlm_paddle, Tlm_score, Tlm_state, Tlm_overrun, Tlm_drop, Tlm_stack };
+
+// Payload length and the task nibble each event type is sent with (0xFF: any task)
+static const unsigned char payload_len[] = { 0, 3, 2, 2, 1, 0, 1, 2 };
+static const unsigned char sender[] = { 0, 1, 3, 1, 0xFF, 0xFF, 0, 0 };
+
+static const char *task_names[] = { "SMDisplay", "SMBall", "SMPlayerPaddle", "SMEnemyPaddle" };
+
+// State names per task, must match the state enums in main.c
+static const char *display_states[] = { "Disp_init", "Disp_start", "Disp_startSequence", "PlayerOutput",
+	"BallOutput", "EnemyOutput", "PWinState", "EnemyWinState" };
+static const char *ball_states[] = { "Ball_init", "Ball_start", "idle", "Ball_Moving", "Ball_Bounce" };
+static const char *player_states[] = { "Paddle_init", "Paddle_start", "Paddle_idle", "Paddle_press",
+	"Paddle_release", "auto_function_press", "auto_function_release" };
+static const char *enemy_states[] = { "EnemyPaddle_init", "EnemyPaddle_start", "EnemyPaddle_idle",
+	"EnemyPaddle_press", "EnemyPaddle_release" };
+
+static const char **state_names[] = { display_states, ball_states, player_states, enemy_states };
+static const unsigned char state_count[] = { 8, 5, 7, 5 };
+
+// Positions are column/row numbers, 0 being the rightmost column and the player's row
+static void PrintPos(const char *name, unsigned char pos)
+{
+	printf(" %s=%d", name, pos);
+}
+
+static const char *StateName(unsigned char task, unsigned char state)
+{
+	if(state < state_count[task]){
+		return state_names[task][state];
+	}
+	return "?";
+}
+
+static void PrintEvent(double t, unsigned char type, unsigned char task, const unsigned char *p, int csv)
+{
+	static const char *type_names[] = { "", "ball", "paddle", "score", "state", "overrun", "drop", "stack" };
+
+	if(csv){
+		printf("%.3f,%s,%d", t, type_names[type], task);
+		for(int n = 0; n < payload_len[type]; n++){
+			printf(",%d", p[n]);
+		}
+		printf("\n");
+		return;
+	}
+
+	printf("%10.3f s  %-8s", t, type_names[type]);
+	switch(type){
+		case Tlm_ball:
+			PrintPos("x", p[0]);
+			PrintPos("y", p[1]);
+			printf(" dir=%s/%s", (p[2] & 0x01) ? "left" : (p[2] & 0x02) ? "right" : "-",
+				(p[2] & 0x04) ? "up" : (p[2] & 0x08) ? "down" : "-");
+		break;
+
+		case Tlm_paddle:
+			PrintPos("player", p[0]);
+			PrintPos("enemy", p[1]);
+		break;
+
+		case Tlm_score:
+			printf(" player=%d enemy=%d", p[0], p[1]);
+		break;
+
+		case Tlm_state:
+			printf(" %s -> %s", task_names[task], StateName(task, p[0]));
+		break;
+
+		case Tlm_overrun:
+			printf(" %s still running at the next tick", task_names[task]);
+		break;
+
+		case Tlm_drop:
+			printf(" %d event(s) lost, buffer full", p[0]);
+		break;
+
+		case Tlm_stack:
+			printf(" %d byte(s) of stack never used", p[0] << 8 | p[1]);
+		break;
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	int csv = 0;
+	int arg;
+
+	for(arg = 1; arg < argc; arg++){
+		if(strcmp(argv[arg], "-c") == 0){
+			csv = 1;
+		}
+		else if(!(in = fopen(argv[arg], "rb"))){
+			perror(argv[arg]);
+			return 1;
+		}
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0); // Live captures should show up as they arrive
+	if(csv){
+		printf("time,event,task,p0,p1,p2\n");
+	}
+
+	// The device only sends the low byte of its ms counter. SMBall reports every
+	// 100 ms, so consecutive events are never 256 ms or more apart.
+	unsigned long ms = 0;
+	int last_time = -1;
+	unsigned long skipped = 0;
+	int c;
+
+	while((c = fgetc(in)) != EOF){
+		unsigned char type = c >> 4;
+		unsigned char task = c & 0x0F;
+		unsigned char p[3];
+		int time;
+		int n;
+
+		// Resynchronise on anything that cannot be an event header
+		if(type < Tlm_ball || type > Tlm_stack || task > 3
+				|| (sender[type] != 0xFF && sender[type] != task)){
+			skipped++;
+			continue;
+		}
+		if((time = fgetc(in)) == EOF){
+			break;
+		}
+		for(n = 0; n < payload_len[type]; n++){
+			if((c = fgetc(in)) == EOF){
+				break;
+			}
+			p[n] = c;
+		}
+		if(n < payload_len[type]){
+			break;
+		}
+
+		if(last_time >= 0){
+			ms += (time - last_time) & 0xFF;
+		}
+		last_time = time;
+		PrintEvent(ms / 1000.0, type, task, p, csv);
+	}
+
+	if(skipped){
+		fprintf(stderr, "tlm_decode: skipped %lu byte(s) while resynchronising\n", skipped);
+	}
+	return 0;
+}
@@ -1,5 +1,6 @@
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <stdio.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -77,6 +78,331 @@ ISR(TIMER1_COMPA_vect)
 	}
 }
 
+//--------Telemetry-----------------------------------------------------------
+// Binary event stream on USART0 TX (PD1, 38400 8N1). The TickFcts push events
+// into TlmBuf, the data-register-empty interrupt drains it one byte at a time.
+// Only the main loop writes TlmHead and only the ISR writes TlmTail, so neither
+// side ever waits on the other. A full buffer drops the event and counts it.
+// Event: [type<<4 | task][time][payload], time is the low byte of the ms tick.
+//   Tlm_ball     payload: BallXPosition, BallYPosition, direction bits
+//   Tlm_paddle   payload: PlayerPaddlePosition, EnemyPaddlePosition
+//   Tlm_score    payload: PlayerScore, EnemyScore
+//   Tlm_state    payload: new state of task
+//   Tlm_overrun  payload: none, task was running when the next tick came due
+//   Tlm_drop     payload: number of events lost since the last Tlm_drop
+//   Tlm_stack    payload: bytes of stack never used so far, high byte first
+// PD1 is also the enemy's second score LED (0x02) and part of the win flash:
+// once the transmitter is on, the USART drives the pin and that LED stays
+// dark. There is no other pin for TX, PORTA/PORTB drive the matrix, PORTC
+// reads the buttons and all of PORTD lights LEDs. The AVR build leaves
+// telemetry off for that reason; build with -DTELEMETRY=1 for a capture or
+// a bench board that does without the LED. The host build has no pin to
+// lose and keeps it on, so every host tool runs the telemetry code.
+#ifndef TELEMETRY
+#ifdef HOST_BUILD
+#define TELEMETRY 1
+#else
+#define TELEMETRY 0
+#endif
+#endif
+#define TLM_SIZE 64 // Must be a power of two
+enum Tlm_Events { Tlm_ball = 1, Tlm_paddle, Tlm_score, Tlm_state, Tlm_overrun, Tlm_drop, Tlm_stack };
+
+unsigned char TlmBuf[TLM_SIZE];
+volatile unsigned char TlmHead = 0; // Next free byte, main loop only
+volatile unsigned char TlmTail = 0; // Next byte to send, ISR only
+unsigned char TlmDropped = 0;
+unsigned char TlmTime = 0;
+unsigned char TlmPlayerPaddle = 0x00; // Last reported paddle positions
+unsigned char TlmEnemyPaddle = 0x00;
+
+void TlmOn() {
+	if(!TELEMETRY){
+		return;
+	}
+	UBRR0H = 0x00;
+	UBRR0L = 12;	// 8,000,000 / (16 * 38400) - 1 = 12
+	UCSR0C = 0x06;	// bit2bit1=11: 8 data bits, no parity, 1 stop bit
+	UCSR0B = 0x08;	// bit3: TXEN0 -- transmitter only, PD0 stays a plain pin
+}
+
+unsigned char TlmPut(unsigned char head, unsigned char value) {
+	TlmBuf[head] = value;
+	return (head + 1) & (TLM_SIZE - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Queues one telemetry event without blocking
+//Parameter: Event type, task index, payload length (0-3) and the payload bytes
+//Returns: Nothing, the event is counted as dropped if the buffer is full
+void TlmEvent(unsigned char type, unsigned char task, unsigned char len,
+		unsigned char a, unsigned char b, unsigned char c)
+{
+	unsigned char head = TlmHead;
+	unsigned char space = (TlmTail - head - 1) & (TLM_SIZE - 1);
+
+	if(!TELEMETRY){
+		return;
+	}
+	// Report earlier losses first so the host can see the gap in the timeline
+	if(TlmDropped && space >= 3 + 2 + len){
+		head = TlmPut(head, Tlm_drop << 4);
+		head = TlmPut(head, TlmTime);
+		head = TlmPut(head, TlmDropped);
+		TlmDropped = 0;
+		space -= 3;
+	}
+	if(TlmDropped || space < 2 + len){
+		if(TlmDropped != 0xFF){
+			TlmDropped++;
+		}
+		return;
+	}
+	head = TlmPut(head, (type << 4) | task);
+	head = TlmPut(head, TlmTime);
+	if(len > 0){ head = TlmPut(head, a); }
+	if(len > 1){ head = TlmPut(head, b); }
+	if(len > 2){ head = TlmPut(head, c); }
+
+	// Publish the whole event at once, then make sure the drain is running.
+	// If the ISR clears UDRIE0 between our read and write it just fires once more.
+	TlmHead = head;
+	UCSR0B |= 0x20;	// bit5: UDRIE0 -- data register empty interrupt
+}
+
+ISR(USART0_UDRE_vect)
+{
+	unsigned char tail = TlmTail;
+	if(tail != TlmHead){
+		UDR0 = TlmBuf[tail];
+		TlmTail = (tail + 1) & (TLM_SIZE - 1);
+	}
+	else{
+		UCSR0B &= ~0x20; // Nothing left, stop until the next TlmEvent
+	}
+}
+//--------End Telemetry-------------------------------------------------------
+
+//--------Playfield geometry--------------------------------------------------
+// Positions are small integers: column 0 is the rightmost (bit 0 of a matrix
+// row, "left" counts up), row 0 the player's row and BOARD_HEIGHT - 1 the
+// enemy's. A row of the playfield is a row_t with bit n = column n; col_t is
+// a mask with bit n = row n, active low like the row lines. Both are the
+// smallest type the board fits in, so an 8x8 board costs no more than the
+// byte-wide code did and a 16x16 one is no slower than it has to be.
+// The matrix on PORTA/PORTB is 8x8; other sizes need DISPLAY_SPI.
+#ifndef BOARD_WIDTH
+#define BOARD_WIDTH 8
+#endif
+#ifndef BOARD_HEIGHT
+#define BOARD_HEIGHT 8
+#endif
+
+#if BOARD_WIDTH < 6 || BOARD_WIDTH > 32
+#error "BOARD_WIDTH must be 6 to 32"
+#elif BOARD_WIDTH <= 8
+typedef unsigned char row_t;
+#elif BOARD_WIDTH <= 16
+typedef unsigned short row_t;
+#else
+typedef unsigned long row_t;
+#endif
+
+#if BOARD_HEIGHT < 6 || BOARD_HEIGHT > 32
+#error "BOARD_HEIGHT must be 6 to 32"
+#elif BOARD_HEIGHT <= 8
+typedef unsigned char col_t;
+#elif BOARD_HEIGHT <= 16
+typedef unsigned short col_t;
+#else
+typedef unsigned long col_t;
+#endif
+
+#define COLUMN(x) ((row_t)1 << (x))
+#define ROW(y) ((col_t)1 << (y))
+#define ALL_COLUMNS ((row_t)(COLUMN(BOARD_WIDTH - 1) * 2 - 1))
+#define ALL_ROWS ((col_t)(ROW(BOARD_HEIGHT - 1) * 2 - 1))
+#define TOP_ROW (BOARD_HEIGHT - 1)
+#define LEFT_COLUMN (BOARD_WIDTH - 1)
+
+// A paddle is three columns wide and its centre never goes onto an edge column
+#define PADDLE_MIN 1
+#define PADDLE_MAX (BOARD_WIDTH - 2)
+#define PADDLE_HOME (BOARD_WIDTH / 2)	// Where both paddles start and serve from
+//--------End Playfield geometry----------------------------------------------
+
+//--------Display backend-----------------------------------------------------
+// DISPLAY_SPI 0: the 8x8 matrix hangs straight off PORTA (columns, bit7 left)
+// and PORTB (rows, active low) and SMDisplay multiplexes it one row at a time.
+// DISPLAY_SPI 1: SMDisplay writes the same values to MatrixCols/MatrixRows.
+// PanelDraw() ORs what they show into PanelAcc every ms and every
+// PANEL_FRAME_MS hands the picture to the SPI interrupt, which streams it to
+// a daisy chain of MAX7219 8x8 modules on PB5 (DIN), PB7 (CLK) and PB4
+// (LOAD). PORTA and the rest of PORTB are free then.
+// The panel is BOARD_WIDTH x BOARD_HEIGHT LEDs, or twice that in either
+// direction, in which case each column/row of the board is two LEDs wide/high
+// (an 8x8 board on 2x1 modules, the default, shows as 16x8).
+// Module k of the chain (0 = nearest the MCU) sits at column block k % X, row
+// block k / X, counted from the bottom right; digit 0 is its bottom row and
+// segment bit 7 its leftmost column.
+#ifndef DISPLAY_SPI
+#define DISPLAY_SPI 0
+#endif
+
+#if DISPLAY_SPI
+#ifndef PANEL_MODULES_X
+#define PANEL_MODULES_X 2	// 8x8 modules across
+#endif
+#ifndef PANEL_MODULES_Y
+#define PANEL_MODULES_Y 1	// 8x8 modules down
+#endif
+#define PANEL_MODULES (PANEL_MODULES_X * PANEL_MODULES_Y)
+#if PANEL_MODULES_X < 1 || PANEL_MODULES_Y < 1 || PANEL_MODULES > 8
+#error "The chain takes 1 to 8 modules"
+#endif
+#if PANEL_MODULES_X * 8 == BOARD_WIDTH
+#define PANEL_SCALE_X 1
+#elif PANEL_MODULES_X * 8 == BOARD_WIDTH * 2
+#define PANEL_SCALE_X 2
+#else
+#error "PANEL_MODULES_X * 8 must be BOARD_WIDTH or twice that"
+#endif
+#if PANEL_MODULES_Y * 8 == BOARD_HEIGHT
+#define PANEL_SCALE_Y 1
+#elif PANEL_MODULES_Y * 8 == BOARD_HEIGHT * 2
+#define PANEL_SCALE_Y 2
+#else
+#error "PANEL_MODULES_Y * 8 must be BOARD_HEIGHT or twice that"
+#endif
+#define PANEL_FRAME_MS 15	// Five PlayerOutput/BallOutput/EnemyOutput scans
+#define SPI_SIZE (8 * PANEL_MODULES * 2)	// One frame: 8 digits, 2 bytes per module
+
+#define MATRIX_COLS MatrixCols
+#define MATRIX_ROWS MatrixRows
+row_t MatrixCols = ALL_COLUMNS;	// Power-on picture as main() leaves PORTA/PORTB
+col_t MatrixRows = 0x00;
+
+row_t PanelAcc[BOARD_HEIGHT];	// Board rows lit since the last frame, bit = column
+unsigned char PanelTime = 0;	// ms into the current frame
+unsigned char PanelDropped = 0;	// Frames skipped because the last one was still going out
+
+unsigned char SpiOut[SPI_SIZE];
+volatile unsigned char SpiIndex = 0;	// Byte on the wire
+volatile unsigned char SpiCount = 0;
+volatile unsigned char SpiBusy = 0;
+
+// Each board column twice: nibble abcd -> aabbccdd
+const unsigned char PanelWiden[16] = {
+	0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+	0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
+};
+
+void SpiStart(unsigned char count) {
+	SpiIndex = 0;
+	SpiCount = count;
+	SpiBusy = 1;
+	SPDR = SpiOut[0];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Queues one MAX7219 register write for every module in the chain
+//Parameter: Position in SpiOut, register address, value
+//Returns: Position after the group
+unsigned char PanelCommand(unsigned char at, unsigned char reg, unsigned char value) {
+	unsigned char k;
+
+	for(k = 0; k < PANEL_MODULES; k++){
+		SpiOut[at++] = reg;
+		SpiOut[at++] = value;
+	}
+	return at;
+}
+
+void PanelOn() {
+	unsigned char at = 0;
+
+	DDRB |= 0xB0;	// bit7 SCK, bit5 MOSI, bit4 SS used as LOAD: outputs
+	PORTB &= ~0x10;
+	SPCR = 0xD0;	// bit7 SPIE, bit6 SPE, bit4 MSTR, mode 0, MSB first
+	SPSR = 0x01;	// bit0 SPI2X: fosc/2 = 4 MHz
+	at = PanelCommand(at, 0x0F, 0x00);	// Display test off
+	at = PanelCommand(at, 0x09, 0x00);	// No BCD decoding
+	at = PanelCommand(at, 0x0B, 0x07);	// Scan all 8 digits
+	at = PanelCommand(at, 0x0A, 0x08);	// Half intensity
+	at = PanelCommand(at, 0x0C, 0x01);	// Leave shutdown
+	SpiStart(at);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Collects what SMDisplay showed this ms and sends finished frames
+//Parameter: None
+//Returns: None
+void PanelDraw() {
+	unsigned char row, digit, k, bits;
+	unsigned char at = 0;
+
+	for(row = 0; row < BOARD_HEIGHT; row++){
+		if(!(MatrixRows & ROW(row))){
+			PanelAcc[row] |= MatrixCols;
+		}
+	}
+	if(++PanelTime < PANEL_FRAME_MS){
+		return;
+	}
+	PanelTime = 0;
+	if(SpiBusy){
+		PanelDropped++;
+	}
+	else{
+		// Farthest module first, it has the longest way through the chain
+		for(digit = 0; digit < 8; digit++){
+			for(k = PANEL_MODULES; k-- > 0; ){
+				bits = PanelAcc[((k / PANEL_MODULES_X) * 8 + digit) / PANEL_SCALE_Y]
+					>> ((k % PANEL_MODULES_X) * 8 / PANEL_SCALE_X);
+				if(PANEL_SCALE_X == 2){
+					bits = PanelWiden[bits & 0x0F];
+				}
+				SpiOut[at++] = digit + 1;
+				SpiOut[at++] = bits;
+			}
+		}
+		SpiStart(at);
+	}
+	for(row = 0; row < BOARD_HEIGHT; row++){
+		PanelAcc[row] = 0x00;
+	}
+}
+
+// LOAD goes high when the last byte of a group is out, latching one word into
+// every module, and low again after the next byte; the MAX7219 shifts
+// whatever the LOAD level, so the next group need not wait.
+ISR(SPI_STC_vect)
+{
+	unsigned char index = SpiIndex + 1;
+
+	if((index % (PANEL_MODULES * 2)) == 0){
+		PORTB |= 0x10;
+	}
+	else{
+		PORTB &= ~0x10;
+	}
+	SpiIndex = index;
+	if(index < SpiCount){
+		SPDR = SpiOut[index];
+	}
+	else{
+		SpiBusy = 0;
+	}
+}
+#else
+#if BOARD_WIDTH != 8 || BOARD_HEIGHT != 8
+#error "PORTA/PORTB drive an 8x8 matrix, build larger boards with DISPLAY_SPI"
+#endif
+#define MATRIX_COLS PORTA
+#define MATRIX_ROWS PORTB
+#endif
+//--------End Display backend-------------------------------------------------
+
 //--------Find GCD function --------------------------------------------------
 unsigned long int findGCD(unsigned long int a, unsigned long int b)
 {
@@ -106,23 +432,350 @@ typedef struct _task {
 
 //--------Shared Variables----------------------------------------------------
 //Output Variables
-	unsigned char PlayerPaddlePosition = 0x10;
-	unsigned char EnemyPaddlePosition = 0x10;
-	unsigned char BallXPosition = 0x00;
-	unsigned char BallYPosition = 0x00;
+	unsigned char PlayerPaddlePosition = PADDLE_HOME;	// Centre column
+	unsigned char EnemyPaddlePosition = PADDLE_HOME;
 	unsigned char PlayerScore = 0x00;
 	unsigned char EnemyScore =0x00;
 //Internal Variables
 	unsigned char Autonomous = 0x00;
-	unsigned char ball_xMove_right =0x00;
-	unsigned char ball_xMove_left =0x00;
-	unsigned char ball_yMove_up =0x01;
-	unsigned char ball_yMove_down =0x00;
-	unsigned char indexXpos = 0x08;
+	unsigned char indexXpos = PADDLE_HOME - 1;
 	unsigned long i = 0;
 	unsigned long AIdumbifier =0;
+	unsigned char Attract = 0x00;	// Demo running, the real game is saved, see Power
+	unsigned long IdleTime = 0;		// ms since a button was last down
+//Ball position and direction are those of Entities[0], see Entities
 //--------End Shared Variables------------------------------------------------
 
+//--------Entities------------------------------------------------------------
+// Balls and obstacles share one fixed array that SMBall walks once per tick.
+// Entity 0 is the ball of the classic game; the old ball variable names are
+// kept for it so the display and telemetry read it as before.
+#define MAX_ENTITIES 8
+
+enum Entity_Kinds { Ent_none, Ent_ball, Ent_block };
+enum Game_Modes { Mode_classic, Mode_multiball, Mode_obstacles, NUM_GAME_MODES };
+
+typedef struct _entity {
+	unsigned char kind;          // Ent_none, Ent_ball or Ent_block
+	unsigned char x;             // Column, see Playfield geometry
+	unsigned char y;             // Row
+	unsigned char left, right;   // Ball direction flags, 0x00 or 0x01
+	unsigned char up, down;
+} entity;
+
+entity Entities[MAX_ENTITIES] = { { Ent_ball, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 } };
+unsigned char GameMode = Mode_classic;
+unsigned char ModeHeld = 0x00;   // Mode button (PC7) was down on the last SMBall tick
+unsigned char DrawIndex = 0;     // Entity BallOutput shows next
+
+#define BallXPosition    Entities[0].x
+#define BallYPosition    Entities[0].y
+#define ball_xMove_left  Entities[0].left
+#define ball_xMove_right Entities[0].right
+#define ball_yMove_up    Entities[0].up
+#define ball_yMove_down  Entities[0].down
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Lays out the balls and obstacles of the current game mode
+//Parameter: None
+//Returns: None
+void EntitiesInit() {
+	unsigned char n;
+
+	// Ball 0 keeps its up/down direction: the side that lost the point serves
+	BallYPosition = 1;
+	BallXPosition = PADDLE_HOME - 1;
+	ball_xMove_left = 0x01;
+	ball_xMove_right = 0x00;
+	for(n = 1; n < MAX_ENTITIES; n++){
+		Entities[n].kind = Ent_none;
+		Entities[n].x = 0;
+		Entities[n].y = 0;
+		Entities[n].left = 0x00;
+		Entities[n].right = 0x00;
+		Entities[n].up = 0x00;
+		Entities[n].down = 0x00;
+	}
+
+	if(GameMode == Mode_multiball){
+		// Second ball starts mirrored, so the two never travel together
+		Entities[1].kind = Ent_ball;
+		Entities[1].x = PADDLE_HOME;
+		Entities[1].y = 2;
+		Entities[1].left = 0x00;
+		Entities[1].right = 0x01;
+		Entities[1].up = 0x01;
+		Entities[1].down = 0x00;
+	}
+	else if(GameMode == Mode_obstacles){
+		Entities[1].kind = Ent_block;
+		Entities[1].x = PADDLE_HOME - 2;
+		Entities[1].y = BOARD_HEIGHT / 2;
+		Entities[2].kind = Ent_block;
+		Entities[2].x = PADDLE_HOME + 1;
+		Entities[2].y = BOARD_HEIGHT / 2 - 1;
+	}
+	DrawIndex = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Turns a ball round after it skimmed a paddle edge (SMBall
+//                leaves it in the paddle row still heading out)
+//Parameter: The ball
+//Returns: None
+void BallEdge(entity *ball) {
+	if((ball->left == 0x01)&&(ball->up == 0x01)&&(ball->y == TOP_ROW)){
+		ball->y--;
+		ball->x--;
+		ball->left = 0x00;
+		ball->right = 0x01;
+		ball->up = 0x00;
+		ball->down = 0x01;
+	}
+	else if((ball->right == 0x01)&&(ball->up == 0x01)&&(ball->y == TOP_ROW)){
+		ball->y--;
+		ball->x++;
+		ball->left = 0x01;
+		ball->right = 0x00;
+		ball->up = 0x00;
+		ball->down = 0x01;
+	}
+	else if((ball->right == 0x01)&&(ball->down == 0x01)&&(ball->y == 0)){
+		ball->y++;
+		ball->x++;
+		ball->left = 0x01;
+		ball->right = 0x00;
+		ball->up = 0x01;
+		ball->down = 0x00;
+	}
+	else if((ball->left == 0x01)&&(ball->down == 0x01)&&(ball->y == 0)){
+		ball->y++;
+		ball->x--;
+		ball->left = 0x00;
+		ball->right = 0x01;
+		ball->up = 0x01;
+		ball->down = 0x00;
+	}
+}
+//--------End Entities--------------------------------------------------------
+
+//--------Playfield bitboards-------------------------------------------------
+// One row_t per board row, bit n = column n; row 0 is the player's row,
+// TOP_ROW the enemy's. SMBall rebuilds it from the paddles and the obstacles
+// before it moves the balls, so any collision is one AND with the ball column.
+row_t Field[BOARD_HEIGHT];
+
+enum Collisions { Ball_miss, Ball_hit, Ball_skim };
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Turns a paddle position into the columns it covers
+//Parameter: Paddle centre column
+//Returns: Row bitmask, cut off at the board edges
+row_t PaddleRow(unsigned char centre) {
+	row_t row = COLUMN(centre);
+
+	return (row | (row << 1) | (row >> 1)) & ALL_COLUMNS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Rebuilds Field from the paddles and the obstacle entities
+//Parameter: None
+//Returns: None
+void FieldUpdate() {
+	unsigned char n;
+
+	for(n = 1; n < TOP_ROW; n++){
+		Field[n] = 0x00;
+	}
+	Field[0] = PaddleRow(PlayerPaddlePosition);
+	Field[TOP_ROW] = PaddleRow(EnemyPaddlePosition);
+	for(n = 0; n < MAX_ENTITIES; n++){
+		if(Entities[n].kind == Ent_block){
+			Field[Entities[n].y] |= COLUMN(Entities[n].x);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Tests a ball against a paddle row of Field
+//Parameter: The ball, row number (0 player, TOP_ROW enemy), that paddle's centre column
+//Returns: Ball_hit, Ball_miss, or Ball_skim when the ball lands on an edge of
+//         the paddle while heading for its centre
+unsigned char Collide(entity *ball, unsigned char row, unsigned char centre) {
+	row_t skim = 0x00;
+
+	if((ball->left == 0x01) && (centre > 0)){
+		skim |= COLUMN(centre - 1);
+	}
+	if((ball->right == 0x01) && (centre < LEFT_COLUMN)){
+		skim |= COLUMN(centre + 1);
+	}
+	if(!(Field[row] & COLUMN(ball->x))){
+		return Ball_miss;
+	}
+	if(skim & COLUMN(ball->x)){
+		return Ball_skim;
+	}
+	return Ball_hit;
+}
+//--------End Playfield bitboards---------------------------------------------
+
+//--------Scrolling text------------------------------------------------------
+// Messages scroll in from the right across the middle of the board, one glyph
+// column every TEXT_SCROLL_MS. The 3x5 glyphs are stored column-major in flash
+// (one byte per column, bit 0 = top row) and so are the strings: the text
+// itself takes no SRAM, only the FONT_HEIGHT rows the columns are shifted
+// into. While TextActive, SMDisplay shows one of those rows per ms in place
+// of the game, so a frame costs the same whatever the message.
+// In a string, TEXT_PLAYER_SCORE and TEXT_ENEMY_SCORE stand for the score
+// digits and TEXT_STACK_DIGIT..+4 for the five digits of StackFree, ten
+// thousands first, all read as the column comes in.
+#define FONT_WIDTH 3
+#define FONT_HEIGHT 5
+#define FONT_FIRST ' '
+#define FONT_LAST 'Z'
+#define TEXT_SCROLL_MS 60
+#define TEXT_TOP ((BOARD_HEIGHT + FONT_HEIGHT) / 2 - 1)	// Board row of the glyph's top row
+#define TEXT_PLAYER_SCORE '\x01'
+#define TEXT_ENEMY_SCORE '\x02'
+#define TEXT_STACK_DIGIT '\x03'
+
+const unsigned char Font[FONT_LAST - FONT_FIRST + 1][FONT_WIDTH] PROGMEM = {
+	{ 0x00, 0x00, 0x00 }, { 0x00, 0x17, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },	// space ! " #
+	{ 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },	// $ % & '
+	{ 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },	// ( ) * +
+	{ 0x00, 0x00, 0x00 }, { 0x04, 0x04, 0x04 }, { 0x00, 0x10, 0x00 }, { 0x00, 0x00, 0x00 },	// , - . /
+	{ 0x1F, 0x11, 0x1F }, { 0x12, 0x1F, 0x10 }, { 0x1D, 0x15, 0x17 }, { 0x11, 0x15, 0x1F },	// 0 1 2 3
+	{ 0x07, 0x04, 0x1F }, { 0x17, 0x15, 0x1D }, { 0x1F, 0x15, 0x1D }, { 0x01, 0x19, 0x07 },	// 4 5 6 7
+	{ 0x1F, 0x15, 0x1F }, { 0x17, 0x15, 0x1F }, { 0x00, 0x0A, 0x00 }, { 0x00, 0x00, 0x00 },	// 8 9 : ;
+	{ 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x01, 0x15, 0x02 },	// < = > ?
+	{ 0x00, 0x00, 0x00 }, { 0x1E, 0x05, 0x1E }, { 0x1F, 0x15, 0x0A }, { 0x0E, 0x11, 0x11 },	// @ A B C
+	{ 0x1F, 0x11, 0x0E }, { 0x1F, 0x15, 0x11 }, { 0x1F, 0x05, 0x01 }, { 0x0E, 0x11, 0x1D },	// D E F G
+	{ 0x1F, 0x04, 0x1F }, { 0x11, 0x1F, 0x11 }, { 0x08, 0x10, 0x0F }, { 0x1F, 0x04, 0x1B },	// H I J K
+	{ 0x1F, 0x10, 0x10 }, { 0x1F, 0x06, 0x1F }, { 0x1F, 0x01, 0x1E }, { 0x0E, 0x11, 0x0E },	// L M N O
+	{ 0x1F, 0x05, 0x02 }, { 0x0E, 0x19, 0x1E }, { 0x1F, 0x05, 0x1A }, { 0x12, 0x15, 0x09 },	// P Q R S
+	{ 0x01, 0x1F, 0x01 }, { 0x1F, 0x10, 0x1F }, { 0x0F, 0x10, 0x0F }, { 0x1F, 0x0C, 0x1F },	// T U V W
+	{ 0x1B, 0x04, 0x1B }, { 0x03, 0x1C, 0x03 }, { 0x19, 0x15, 0x13 },	// X Y Z
+};
+
+const char MsgScore[] PROGMEM = "\x01-\x02";	// TEXT_PLAYER_SCORE - TEXT_ENEMY_SCORE
+const char MsgPlayerWins[] PROGMEM = "P1 WINS";
+const char MsgEnemyWins[] PROGMEM = "P2 WINS";
+const char MsgModes[NUM_GAME_MODES][10] PROGMEM = { "CLASSIC", "MULTIBALL", "OBSTACLES" };
+const char MsgStack[] PROGMEM = "SP \x03\x04\x05\x06\x07";	// SP and the TEXT_STACK_DIGITs
+
+// Fewest stack bytes never touched so far, kept by StackScan (Stack watermark).
+// The host build has no stack to watch and leaves it at 0xFFFF.
+unsigned short StackFree = 0xFFFF;
+
+row_t TextRows[FONT_HEIGHT];	// What is on the board, [0] = top row of the glyphs
+const char *TextPos = 0;	// Next character, in flash
+unsigned char TextColumn = 0;	// Its glyph column that comes in next, FONT_WIDTH = the gap after it
+unsigned char TextTail = 0;	// Blank columns still to come after the string, to scroll it off
+unsigned char TextTime = 0;	// ms since the last column came in
+unsigned char TextRow = 0;	// Row SMDisplay shows next
+unsigned char TextActive = 0x00;
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Starts a message scrolling in, in place of any before it
+//Parameter: The string, in flash
+//Returns: None
+void TextStart(const char *text) {
+	unsigned char row;
+
+	for(row = 0; row < FONT_HEIGHT; row++){
+		TextRows[row] = 0;
+	}
+	TextPos = text;
+	TextColumn = 0;
+	TextTail = BOARD_WIDTH;
+	TextTime = 0;
+	TextRow = 0;
+	TextActive = 0x01;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Reads one column of a character's glyph from flash
+//Parameter: The character, the column (0 = left)
+//Returns: The column, bit 0 = top row
+unsigned char TextGlyph(char c, unsigned char column) {
+	unsigned short value;
+	unsigned char place;
+
+	if(c == TEXT_PLAYER_SCORE){
+		c = '0' + PlayerScore;
+	}
+	else if(c == TEXT_ENEMY_SCORE){
+		c = '0' + EnemyScore;
+	}
+	else if((c >= TEXT_STACK_DIGIT) && (c < TEXT_STACK_DIGIT + 5)){
+		value = StackFree;
+		for(place = c - TEXT_STACK_DIGIT; place < 4; place++){
+			value /= 10;
+		}
+		c = '0' + value % 10;
+	}
+	if((c < FONT_FIRST) || (c > FONT_LAST)){
+		c = FONT_FIRST;
+	}
+	return pgm_read_byte(&Font[c - FONT_FIRST][column]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Shows the score after a point, or who won
+//Parameter: None
+//Returns: None
+void TextPoint() {
+	if(PlayerScore == 0x04){
+		TextStart(MsgPlayerWins);
+	}
+	else if(EnemyScore == 0x04){
+		TextStart(MsgEnemyWins);
+	}
+	else{
+		TextStart(MsgScore);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Brings in the next column when it is due and puts one row
+//                of the message on the matrix; SMDisplay calls it every ms
+//Parameter: None
+//Returns: None
+void TextDraw() {
+	unsigned char row;
+	unsigned char bits = 0x00;
+	char c;
+
+	if(++TextTime >= TEXT_SCROLL_MS){
+		TextTime = 0;
+		c = pgm_read_byte(TextPos);
+		if(c != 0){
+			if(TextColumn < FONT_WIDTH){
+				bits = TextGlyph(c, TextColumn);
+			}
+			if(++TextColumn > FONT_WIDTH){
+				TextColumn = 0;
+				TextPos++;
+			}
+		}
+		else if(TextTail != 0){
+			TextTail--;
+		}
+		else{
+			TextActive = 0x00;	// Scrolled off, the game shows again
+			return;
+		}
+		//Everything moves one column left, the new one comes in on the right
+		for(row = 0; row < FONT_HEIGHT; row++){
+			TextRows[row] = ((TextRows[row] << 1) & ALL_COLUMNS) | ((bits >> row) & 0x01);
+		}
+	}
+	MATRIX_ROWS = ALL_ROWS & ~ROW(TEXT_TOP - TextRow);
+	MATRIX_COLS = TextRows[TextRow];
+	TextRow = (TextRow + 1) % FONT_HEIGHT;
+}
+//--------End Scrolling text--------------------------------------------------
+
 //--------User defined FSMs---------------------------------------------------
 enum Display_States { Disp_init, Disp_start, Disp_startSequence, PlayerOutput, BallOutput, EnemyOutput, PWinState, EnemyWinState };
 	//DISPLAY: 
@@ -136,6 +789,8 @@ enum Display_States { Disp_init, Disp_start, Disp_startSequence, PlayerOutput, B
 		//EnemyWinState:      Displays win sequence for 3-4 seconds
 		
 int SMDisplay(int state) {
+	unsigned char n;
+
 	//State machine transitions
 switch(state){
 		case Disp_init:
@@ -224,91 +879,44 @@ switch(state){
 	//State machine actions
 	switch(state){
 		case Disp_init:
-			PORTA = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
 		break;
 		
 		case Disp_start:
-			PORTB = 0x0F;
+			MATRIX_ROWS = ROW(BOARD_HEIGHT / 2) - 1;	//Top half on
 		break;
 		
 		case Disp_startSequence:
-			PORTB = 0xF0;
+			MATRIX_ROWS = ALL_ROWS & ~(ROW(BOARD_HEIGHT / 2) - 1);	//Bottom half on
 		break;
 		
 		case PlayerOutput:
-			 // there are 6 different combinations of positions
-			
-			if(PlayerPaddlePosition == 0x10){
-				PORTA = 0x38;   //001x1000
-			}
-			else if(PlayerPaddlePosition == 0x20){
-				PORTA= 0x70;	//01x10000
-			}
-			else if(PlayerPaddlePosition == 0x40){
-				PORTA= 0xE0;	//1x100000
-			}
-			else if(PlayerPaddlePosition == 0x08){
-				PORTA = 0x1C;	//0001x100
-			}
-			else if(PlayerPaddlePosition == 0x04){
-				PORTA = 0x0E;	//00001x10
-			}
-			else if(PlayerPaddlePosition == 0x02){
-				PORTA = 0x07;	//000001x1	
-			}
-		//PORTB stays the same, since player cannot move paddle up
-			PORTB = 0xFE;
-		//PORTA changes everytime button is pressed
+			 // the centre column and one either side, e.g. 001x1000
+			MATRIX_COLS = PaddleRow(PlayerPaddlePosition);
+		//MATRIX_ROWS stays the same, since player cannot move paddle up
+			MATRIX_ROWS = ALL_ROWS & ~ROW(0);
+		//MATRIX_COLS changes everytime button is pressed
 			
 		break;
 		
 		case BallOutput:
-		//ball position will only depend from the Up-down motion 
-		if((ball_xMove_left == 0x01)&&(ball_yMove_up== 0x01)&&(BallYPosition == 0x80)){
-			BallYPosition = BallYPosition >>1;
-			BallXPosition = BallXPosition >>1;
-			PORTB = ~BallYPosition;
-			ball_xMove_left =0x00;
-			ball_xMove_right=0x01;
-			ball_yMove_up = 0x00;
-			ball_yMove_down = 0x01;
-		}
-		else if((ball_xMove_right == 0x01)&&(ball_yMove_up == 0x01)&&(BallYPosition == 0x80)){
-			BallYPosition = BallYPosition >>1;
-			BallXPosition = BallXPosition <<1;
-			PORTB = ~BallYPosition;
-			ball_xMove_left = 0x01;
-			ball_xMove_right = 0x00;
-			ball_yMove_up = 0x00;
-			ball_yMove_down= 0x01;
-		}
-		else if((ball_xMove_right== 0x01)&&(ball_yMove_down == 0x01)&&(BallYPosition == 0x01)){
-			BallYPosition = BallYPosition <<1;
-			BallXPosition = BallXPosition <<1;
-			PORTB = ~BallYPosition;
-			ball_xMove_left = 0x01;
-			ball_xMove_right = 0x00;
-			ball_yMove_up = 0x01;
-			ball_yMove_down= 0x00;
-		}
-		else if((ball_xMove_left== 0x01)&&(ball_yMove_down == 0x01)&&(BallYPosition == 0x01)){
-			BallYPosition = BallYPosition <<1;
-			BallXPosition = BallXPosition >>1;
-			PORTB = ~BallYPosition;
-			ball_xMove_left = 0x00;
-			ball_xMove_right = 0x01;
-			ball_yMove_up = 0x01;
-			ball_yMove_down= 0x00;
+		//ball position will only depend from the Up-down motion
+		for(n = 0; n < MAX_ENTITIES; n++){
+			if(Entities[n].kind == Ent_ball){
+				BallEdge(&Entities[n]);
+			}
 		}
-		else{
-		PORTB = ~BallYPosition;
+		//One entity per visit, taking turns when there are several
+		for(n = 0; (n < MAX_ENTITIES) && (Entities[DrawIndex].kind == Ent_none); n++){
+			DrawIndex = (DrawIndex + 1) % MAX_ENTITIES;
 		}
-		
-		PORTA = BallXPosition;
+		MATRIX_ROWS = ALL_ROWS & ~ROW(Entities[DrawIndex].y);
+		MATRIX_COLS = COLUMN(Entities[DrawIndex].x);
+		DrawIndex = (DrawIndex + 1) % MAX_ENTITIES;
 		break;
 		
 		case EnemyOutput:
-		PORTB = 0x7F;
+		MATRIX_ROWS = ALL_ROWS & ~ROW(TOP_ROW);
 				//Autopilot, included these lines to make the unbeatable AI, beatable. <3 still pretty hard
 					if(Autonomous == 0x01){
 						AIdumbifier++;
@@ -327,55 +935,47 @@ switch(state){
 							}
 							else if(EnemyPaddlePosition < BallXPosition){ // Move Right
 								EnemyPaddlePosition  -=1;
+							}
 						}
 					}
 		
 		
-					if(EnemyPaddlePosition == 0x10){
-						PORTA = 0x38;   //001x1000
-					}
-					else if(EnemyPaddlePosition == 0x20){
-						PORTA= 0x70;	//01x10000
+					//The AI can push the paddle onto an edge column, draw it one in
+					if(EnemyPaddlePosition > PADDLE_MAX){
+						MATRIX_COLS = PaddleRow(PADDLE_MAX);
 					}
-					else if((EnemyPaddlePosition == 0x40)|| (EnemyPaddlePosition == 0x80)){
-						PORTA= 0xE0;	//1x100000
+					else if(EnemyPaddlePosition < PADDLE_MIN){
+						MATRIX_COLS = PaddleRow(PADDLE_MIN);
 					}
-					
-					else if(EnemyPaddlePosition == 0x08){
-						PORTA = 0x1C;	//0001x100
-					}
-					else if(EnemyPaddlePosition == 0x04){
-						PORTA = 0x0E;	//00001x10
-					}
-					else if((EnemyPaddlePosition == 0x02)||(EnemyPaddlePosition == 0x01)){
-						PORTA = 0x07;	//000001x1
+					else{
+						MATRIX_COLS = PaddleRow(EnemyPaddlePosition);
 					}
 		break;
 		
 		case PWinState:
 		if(i<200){
-			PORTA = 0xFF;
-			PORTB = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS;
 			PORTD = 0xF0;
 		}
 		else if((i>200)&&(i <400)){
-			PORTA = 0xFF;
-			PORTB = 0xF1;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS & ~(ROW(1) | ROW(2) | ROW(3));
 			PORTD = 0x00;
 		}
 		else if((i>400)&&(i <600)){
-			PORTA = 0xFF;
-			PORTB = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS;
 			PORTD = 0xF0;
 		}
 		else if((i>600)&&(i <800)){
-			PORTA = 0xFF;
-			PORTB = 0xF1;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS & ~(ROW(1) | ROW(2) | ROW(3));
 			PORTD = 0xFF;
 		}
 		else if((i>800)){
-			PORTA = 0xFF;
-			PORTB = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS;
 			PORTD = 0x00;
 		}	
 		else if((i > 900)){
@@ -393,28 +993,28 @@ switch(state){
 			
 		case EnemyWinState:
 		if(i<200){
-			PORTA = 0xFF;
-			PORTB = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS;
 			PORTD = 0x00;
 		}
 		else if((i>200)&&(i <400)){
-			PORTA = 0xFF;
-			PORTB = 0x8F;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS & ~(ROW(TOP_ROW - 1) | ROW(TOP_ROW - 2) | ROW(TOP_ROW - 3));
 			PORTD = 0x0F;
 		}
 		else if((i>400)&&(i <600)){
-			PORTA = 0xFF;
-			PORTB = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS;
 			PORTD = 0x00;
 		}
 		else if((i>600)&&(i <800)){
-			PORTA = 0xFF;
-			PORTB = 0x8F;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS & ~(ROW(TOP_ROW - 1) | ROW(TOP_ROW - 2) | ROW(TOP_ROW - 3));
 			PORTD = 0xFF;
 		}
 		else if((i>800)){
-			PORTA = 0xFF;
-			PORTB = 0xFF;
+			MATRIX_COLS = ALL_COLUMNS;
+			MATRIX_ROWS = ALL_ROWS;
 			PORTD = 0x00;
 		}
 		else{
@@ -427,11 +1027,145 @@ switch(state){
 		break;
 	break;
 }
+	//A scrolling message covers the game while it lasts
+	if(TextActive == 0x01){
+		TextDraw();
+	}
+	//Demo: rows lit one ms in four. The game logic in here still runs every ms,
+	//so the saving is in the LEDs; the CPU saves in the main loop's idle sleep
+	if((Attract == 0x01) && (IdleTime & 0x03)){
+		MATRIX_ROWS = ALL_ROWS;
+	}
+#if DISPLAY_SPI
+	PanelDraw();
+#endif
 	
 	return state;
 }
 
 enum SMBall_States { Ball_init, Ball_start,idle, Ball_Moving,Ball_Bounce};
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Moves one ball a step and bounces it off walls, obstacles and paddles
+//Parameter: The ball, SMBall's current state
+//Returns: SMBall's state, Ball_init when the ball got past a paddle
+int BallMove(entity *ball, int state) {
+	unsigned char collision;
+
+	//X-coordinate movement
+	if((ball->left == 0x01)){
+		if(ball->x != LEFT_COLUMN){
+		ball->x = ball->x + 1;
+		}
+		else{
+			
+			ball->left = 0x00;
+			ball->right = 0x01;
+		}
+	}
+	if(ball->right == 0x01){
+		if(ball->x != 0){
+			ball->x = ball->x - 1;
+		}
+		else{
+			ball->x = ball->x + 1;
+			ball->left = 0x01;
+			ball->right = 0x00;
+		}
+	}
+	
+	
+	//Y-coordinate movement
+	if((ball->up == 0x01)){
+		if((ball->y != TOP_ROW)){
+			ball->y = ball->y + 1;
+			if((ball->y != TOP_ROW) && (Field[ball->y] & COLUMN(ball->x))){
+				// Obstacle in the way: stay in this row and head back down
+				ball->y = ball->y - 1;
+				ball->up = 0x00;
+				ball->down = 0x01;
+			}
+		}
+		
+		if((ball->y == TOP_ROW)){
+			
+			// A skim (paddle edge, heading for the centre) is left to BallOutput
+			collision = Collide(ball, TOP_ROW, EnemyPaddlePosition);
+			if(collision == Ball_hit){
+				ball->y = ball->y - 1;
+				ball->down = 0x01;
+				ball->up = 0x00;
+			}
+			else if(collision == Ball_miss){		///SCOREE AGAINST ENEMY////////////////////////////////////////////////////
+				state = Ball_init;
+				PlayerScore = PlayerScore +1;
+				EnemyPaddlePosition = PADDLE_HOME;
+				//The serve direction goes on ball 0, whichever ball missed: EntitiesInit keeps it
+				ball_yMove_up = 0x00;
+				ball_yMove_down = 0x01;
+				if(PlayerScore == 0x01){
+					PORTD = PORTD|0x80;
+				}
+				if(PlayerScore == 0x02){
+					PORTD = PORTD|0x20;
+				}
+				if(PlayerScore == 0x03){
+					PORTD = PORTD|0x40;
+				}
+				if(PlayerScore == 0x04){
+					PORTD = 0x00;
+				}
+				TlmEvent(Tlm_score, 1, 2, PlayerScore, EnemyScore, 0);
+				TextPoint();
+
+			}
+		}
+	}
+	
+	
+		/// LOGIC OF Player Paddle hits///////////////////////////////////
+	if(ball->down == 0x01){
+		if((ball->y != 0)){
+			ball->y = ball->y - 1;
+			if((ball->y != 0) && (Field[ball->y] & COLUMN(ball->x))){
+				ball->y = ball->y + 1;
+				ball->down = 0x00;
+				ball->up = 0x01;
+			}
+		}
+		
+		if((ball->y == 0)){
+			
+			collision = Collide(ball, 0, PlayerPaddlePosition);
+			if(collision == Ball_hit){
+				ball->y = ball->y + 2;
+				ball->down = 0x00;
+				ball->up = 0x01;
+			}
+			else if(collision == Ball_miss){		///SCOREE AGAINST PLAYER////////////////////////////////////////////////////
+					state = Ball_init;
+					EnemyScore +=1;
+					PlayerPaddlePosition = PADDLE_HOME;
+				ball_yMove_up = 0x01;
+				ball_yMove_down = 0x00;
+				if(EnemyScore == 0x01){
+					PORTD = PORTD|0x01;
+				}
+				if(EnemyScore == 0x02){
+					PORTD = PORTD|0x02;
+				}
+				if(EnemyScore == 0x03){
+					PORTD = PORTD|0x04;
+				}
+				TlmEvent(Tlm_score, 1, 2, PlayerScore, EnemyScore, 0);
+				TextPoint();
+				
+			}
+		}
+	}
+	return state;
+}
+
 	//BALL: Contains most game logic
 		//Ball_init:		 NULL
 		//Ball_start:		 Initializes all inputs
@@ -439,6 +1173,8 @@ enum SMBall_States { Ball_init, Ball_start,idle, Ball_Moving,Ball_Bounce};
 		//Ball_Moving:		 Contains bounce logic and iteration of ball movement
 		//Ball_Bounce:       NULL
 int SMBall(int state) {
+	unsigned char n;
+
 	if(i == 999){
 		state = Ball_init;
 		PORTD = 0x00;
@@ -458,26 +1194,49 @@ int SMBall(int state) {
 		
 			if((~PINC&0x08)== 0x08){
 				state = idle;
-				PlayerPaddlePosition = 0x10;
-				EnemyPaddlePosition = 0x10;
+				PlayerPaddlePosition = PADDLE_HOME;
+				EnemyPaddlePosition = PADDLE_HOME;
 				PlayerScore = 0x00;
 				EnemyScore = 0x00;
 				PORTD = 0x00;
 					}
-		if(PlayerPaddlePosition == 0x20){
+		//Mode button: next game mode, laid out straight away. With Restart
+		//held it shows the stack watermark instead, telemetry or not
+		if((~PINC&0x80) == 0x80){
+			if(ModeHeld == 0x00){
+				if((~PINC&0x08) == 0x08){
+					TextStart(MsgStack);
+				}
+				else{
+					GameMode = (GameMode + 1) % NUM_GAME_MODES;
+					EntitiesInit();
+					TextStart(MsgModes[GameMode]);
+				}
+			}
+			ModeHeld = 0x01;
+		}
+		else{
+			ModeHeld = 0x00;
+		}
+		//No serve while the win sequence is showing, a point would take the score past 4
+		if((PlayerScore == 0x04) || (EnemyScore == 0x04)){
+			state = idle;
+		}
+		//Paddle moved onto a trigger column
+		else if(PlayerPaddlePosition == PADDLE_HOME + 1){
 			state = Ball_Moving;
 			ball_xMove_left = 0x01;
 			ball_xMove_right = 0x00;
 		}
-		else if(PlayerPaddlePosition == 0x04){
+		else if(PlayerPaddlePosition == PADDLE_HOME - 2){
 			state = Ball_Moving;
 			ball_xMove_right = 0x01;
 			ball_xMove_left = 0x00;
 		}
 
-		else if((~PINC&0x04) == 0x04){
+		else if(((~PINC&0x04) == 0x04) || (Attract == 0x01)){
 			state =  Ball_Moving;
-			if(PlayerPaddlePosition ==0x10){
+			if(PlayerPaddlePosition ==PADDLE_HOME){
 				ball_xMove_left = 0x01;
 				ball_xMove_right = 0x00;
 			}
@@ -489,20 +1248,24 @@ int SMBall(int state) {
 		else{
 			state = idle;
 		}
+		//The serve clears any message off the board
+		if(state == Ball_Moving){
+			TextActive = 0x00;
+		}
 		break;
 		case Ball_Moving:
 			if((~PINC&0x08)== 0x08){
 				state = Ball_start;
-				PlayerPaddlePosition = 0x10;
-				EnemyPaddlePosition = 0x10;
+				PlayerPaddlePosition = PADDLE_HOME;
+				EnemyPaddlePosition = PADDLE_HOME;
 				PlayerScore = 0x00;
 				EnemyScore = 0x00;
 				PORTD = 0x00;
 			}
-			else if((BallYPosition == 0x01)){
+			else if((BallYPosition == 0)){
 				//add Score
 			}
-			else if((BallYPosition == 0x80)){
+			else if((BallYPosition == TOP_ROW)){
 				//add Score 
 			}
 			else{
@@ -534,178 +1297,32 @@ int SMBall(int state) {
 		break;
 		
 		case Ball_start:
-			BallYPosition = 0x02;
-			BallXPosition = 0x08;
-			ball_xMove_left = 0x01;
-			ball_xMove_right = 0x00;
+			EntitiesInit();
 			indexXpos = BallXPosition;
-			EnemyPaddlePosition = 0x10;
-			PlayerPaddlePosition = 0x10;
+			EnemyPaddlePosition = PADDLE_HOME;
+			PlayerPaddlePosition = PADDLE_HOME;
 		break;
 		case idle:
 			
 		break;
 		case Ball_Moving:
-		
-			//X-coordinate movement
-			if((ball_xMove_left == 0x01)){
-				if(BallXPosition != 0x80){
-				BallXPosition = BallXPosition <<1;
-				}
-				else{
-					
-					ball_xMove_left = 0x00;
-					ball_xMove_right = 0x01;
-				}
-			}
-			if(ball_xMove_right == 0x01){
-				if(BallXPosition != 0x01){
-					BallXPosition = BallXPosition >>1;
-				}
-				else{
-					BallXPosition = BallXPosition <<1;
-					ball_xMove_left = 0x01;
-					ball_xMove_right = 0x00;
-				}
-			}
-	
-	
-			//Y-coordinate movement
-			if((ball_yMove_up == 0x01)){
-				if((BallYPosition != 0x80)){
-					BallYPosition = BallYPosition <<1;
-				}
-				
-				if((BallYPosition == 0x80)){
-					
-					if(EnemyPaddlePosition == BallXPosition){
-						BallYPosition = BallYPosition >>1;
-						ball_yMove_down = 0x01;
-						ball_yMove_up = 0x00;
-					}
-					else if(EnemyPaddlePosition ==(BallXPosition<<1)){
-						if(ball_xMove_left == 0x01){
-							//nothing
-							if(EnemyPaddlePosition == (BallXPosition>>1)){
-								BallYPosition = BallYPosition >>1;
-								ball_yMove_down = 0x01;
-								ball_yMove_up = 0x00;
-							}
-						}
-						else{
-							BallYPosition = BallYPosition >>1;
-							ball_yMove_down = 0x01;
-							ball_yMove_up = 0x00;
-						}
-					}
-					else if(EnemyPaddlePosition == (BallXPosition >>1)){
-						if(ball_xMove_right == 0x01){
-							//nothing
-							if(EnemyPaddlePosition == (BallXPosition<<1)){
-								BallYPosition = BallYPosition >>1;
-								ball_yMove_down = 0x01;
-								ball_yMove_up = 0x00;
-							}
-						}
-						else{
-							BallYPosition = BallYPosition >>1;
-							ball_yMove_down = 0x01;
-							ball_yMove_up = 0x00;
-						}
-					}
-					else{		///SCOREE AGAINST ENEMY////////////////////////////////////////////////////
-						state = Ball_init;
-						PlayerScore = PlayerScore +1;
-						EnemyPaddlePosition = 0x10;
-						ball_yMove_up = 0x00;
-						ball_yMove_down = 0x01;
-						if(PlayerScore == 0x01){
-							PORTD = PORTD|0x80;
-						}
-						if(PlayerScore == 0x02){
-							PORTD = PORTD|0x20;
-						}
-						if(PlayerScore == 0x03){
-							PORTD = PORTD|0x40;
-						}
-						if(PlayerScore == 0x04){
-							PORTD = 0x00;
-						}
-
-					}
-				}
-			}
-			
-			
-				/// LOGIC OF Player Paddle hits///////////////////////////////////
-			if(ball_yMove_down == 0x01){
-				if((BallYPosition != 0x01)){
-					BallYPosition = BallYPosition >>1;
-				}
-				
-				if((BallYPosition == 0x01)){
-					
-					if(PlayerPaddlePosition == BallXPosition){
-						BallYPosition = BallYPosition <<2;
-						ball_yMove_down = 0x00;
-						ball_yMove_up = 0x01;
-					}
-					else if(PlayerPaddlePosition ==(BallXPosition<<1)){
-						if(ball_xMove_left == 0x01){
-							//nothing
-							if(PlayerPaddlePosition == (BallXPosition>>1)){
-								BallYPosition = BallYPosition <<3;
-								ball_yMove_down = 0x00;
-								ball_yMove_up = 0x01;
-							}
-						}
-						else{
-						BallYPosition = BallYPosition <<2;
-						ball_yMove_down = 0x00;
-						ball_yMove_up = 0x01;
-						}
-					}
-					else if(PlayerPaddlePosition == (BallXPosition >>1)){
-						if(ball_xMove_right == 0x01){
-							//nothing	
-							if(PlayerPaddlePosition == (BallXPosition<<1)){
-								BallYPosition = BallYPosition <<3;
-								ball_yMove_down = 0x00;
-								ball_yMove_up = 0x01;
-							}
-						}
-						else{
-							BallYPosition = BallYPosition <<2;
-							ball_yMove_down = 0x00;
-							ball_yMove_up = 0x01;
-						}
-					}
-					else{		///SCOREE AGAINST PLAYER////////////////////////////////////////////////////
-							state = Ball_init;
-							EnemyScore +=1;
-							PlayerPaddlePosition = 0x10;
-						ball_yMove_up = 0x01;
-						ball_yMove_down = 0x00;
-						if(EnemyScore == 0x01){
-							PORTD = PORTD|0x01;
-						}
-						if(EnemyScore == 0x02){
-							PORTD = PORTD|0x02;
-						}
-						if(EnemyScore == 0x03){
-							PORTD = PORTD|0x04;
-						}
-						
+			FieldUpdate();
+			for(n = 0; n < MAX_ENTITIES; n++){
+				if(Entities[n].kind == Ent_ball){
+					state = BallMove(&Entities[n], state);
+					if(state == Ball_init){
+						break; // A point was scored, every ball starts over
 					}
 				}
 			}
-			
 		break;
 		
 		case Ball_Bounce:
 	break;
 		
 	}
+	TlmEvent(Tlm_ball, 1, 3, BallXPosition, BallYPosition,
+		ball_xMove_left | (ball_xMove_right << 1) | (ball_yMove_up << 2) | (ball_yMove_down << 3));
 	return state;
 }
 
@@ -731,7 +1348,7 @@ int SMPlayerPaddle(int state) {
 		case Paddle_idle:
 			//move left
 			if((~PINC&0x01)==0x01){ 
-				if(PlayerPaddlePosition != 0x40){
+				if(PlayerPaddlePosition != PADDLE_MAX){
 					state = Paddle_press;
 				}
 				else{
@@ -739,7 +1356,7 @@ int SMPlayerPaddle(int state) {
 				}
 			}
 			else if((~PINC&0x02)==0x02){
-				if(PlayerPaddlePosition != 0x02){
+				if(PlayerPaddlePosition != PADDLE_MIN){
 					state = Paddle_press;
 				}
 				else{
@@ -809,16 +1426,16 @@ int SMPlayerPaddle(int state) {
 	break;
 	case Paddle_press:
 			if((~PINC&0x01)==0x01){
-				if(PlayerPaddlePosition != 0x40){
-					PlayerPaddlePosition = PlayerPaddlePosition <<1;
+				if(PlayerPaddlePosition != PADDLE_MAX){
+					PlayerPaddlePosition = PlayerPaddlePosition + 1;
 				}
 				else{
 					PlayerPaddlePosition = PlayerPaddlePosition;
 				}
 			}
 			else if((~PINC&0x02)==0x02){
-				if(PlayerPaddlePosition != 0x02){
-					PlayerPaddlePosition = PlayerPaddlePosition >>1;
+				if(PlayerPaddlePosition != PADDLE_MIN){
+					PlayerPaddlePosition = PlayerPaddlePosition - 1;
 				}
 				else{
 					PlayerPaddlePosition = PlayerPaddlePosition;
@@ -828,6 +1445,16 @@ int SMPlayerPaddle(int state) {
 	break;
 	}
 
+	//Demo: the player paddle follows the ball
+	if(Attract == 0x01){
+		if((PlayerPaddlePosition < BallXPosition) && (PlayerPaddlePosition != PADDLE_MAX)){
+			PlayerPaddlePosition = PlayerPaddlePosition + 1;
+		}
+		else if((PlayerPaddlePosition > BallXPosition) && (PlayerPaddlePosition != PADDLE_MIN)){
+			PlayerPaddlePosition = PlayerPaddlePosition - 1;
+		}
+	}
+
 	return state;
 }
 
@@ -851,7 +1478,7 @@ switch (state) {
 	case EnemyPaddle_idle:
 	//move left
 		if((~PINC&0x10)==0x10){ 
-			if(EnemyPaddlePosition != 0x40){
+			if(EnemyPaddlePosition != PADDLE_MAX){
 				state = EnemyPaddle_press;
 			}
 			else{
@@ -859,7 +1486,7 @@ switch (state) {
 			}
 		}
 		else if((~PINC&0x20)==0x20){
-			if(PlayerPaddlePosition != 0x20){
+			if(PlayerPaddlePosition != PADDLE_HOME + 1){
 				state = EnemyPaddle_press;
 			}
 			else{
@@ -901,16 +1528,16 @@ switch (state) {
 	
 	case Paddle_press:
 			if((~PINC&0x10)==0x10){
-				if(EnemyPaddlePosition != 0x40){
-					EnemyPaddlePosition = EnemyPaddlePosition <<1;
+				if(EnemyPaddlePosition != PADDLE_MAX){
+					EnemyPaddlePosition = EnemyPaddlePosition + 1;
 				}
 				else{
 					EnemyPaddlePosition = EnemyPaddlePosition;
 				}
 			}
 			else if((~PINC&0x20)==0x20){
-				if(EnemyPaddlePosition != 0x02){
-					EnemyPaddlePosition = EnemyPaddlePosition >>1;
+				if(EnemyPaddlePosition != PADDLE_MIN){
+					EnemyPaddlePosition = EnemyPaddlePosition - 1;
 				}
 				else{
 					EnemyPaddlePosition = EnemyPaddlePosition;
@@ -920,13 +1547,367 @@ switch (state) {
 	break;
 	}
 
-	
+	// Both paddles have ticked by now; this also catches the Autonomous AI moves
+	if((PlayerPaddlePosition != TlmPlayerPaddle)||(EnemyPaddlePosition != TlmEnemyPaddle)){
+		TlmPlayerPaddle = PlayerPaddlePosition;
+		TlmEnemyPaddle = EnemyPaddlePosition;
+		TlmEvent(Tlm_paddle, 3, 2, PlayerPaddlePosition, EnemyPaddlePosition, 0);
+	}
 
 	return state;
 }
 
 // --------END User defined FSMs-----------------------------------------------
 
+//--------Scheduler-----------------------------------------------------------
+// Declare an array of tasks
+static task task1, task2, task3, task4;
+task *tasks[] = { &task1, &task2, &task3, &task4 };
+const unsigned short numTasks = sizeof(tasks)/sizeof(task*);
+
+//Greatest common divisor for all tasks or smallest time unit for tasks.
+unsigned long int GCD = 1;
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Computes the task periods and puts every task in its init state
+//Parameter: None
+//Returns: Nothing, GCD holds the tick length in ms afterwards
+void SchedulerInit()
+{
+	// Period for the tasks
+	unsigned long int SMDisplay_calc = 1;
+	unsigned long int SMBall_calc = 100;
+	unsigned long int SMPlayerPaddle_calc = 25;
+	unsigned long int SMEnemyPaddle_calc = 25;
+
+	//Calculating GCD
+	unsigned long int tmpGCD = 1;
+	tmpGCD = findGCD(SMDisplay_calc, SMBall_calc);
+	tmpGCD = findGCD(tmpGCD, SMPlayerPaddle_calc);
+	tmpGCD = findGCD(tmpGCD, SMEnemyPaddle_calc);
+	GCD = tmpGCD;
+
+	//Recalculate GCD periods for scheduler
+	unsigned long int SMDisplay_period = SMDisplay_calc/GCD;
+	unsigned long int SMBall_period = SMBall_calc/GCD;
+	unsigned long int SMPlayerPaddle_period = SMPlayerPaddle_calc/GCD;
+	unsigned long int SMEnemyPaddle_period = SMEnemyPaddle_calc/GCD;
+
+	// Task 1
+	task1.state = 0;//Task initial state.
+	task1.period = SMDisplay_period;//Task Period.
+	task1.elapsedTime = SMDisplay_period;//Task current elapsed time.
+	task1.TickFct = &SMDisplay;//Function pointer for the tick.
+
+	// Task 2
+	task2.state = 0;//Task initial state.
+	task2.period = SMBall_period;//Task Period.
+	task2.elapsedTime = SMBall_period;//Task current elapsed time.
+	task2.TickFct = &SMBall;//Function pointer for the tick.
+
+	// Task 3
+	task3.state = 0;//Task initial state.
+	task3.period = SMPlayerPaddle_period;//Task Period.
+	task3.elapsedTime = SMPlayerPaddle_period; // Task current elasped time.
+	task3.TickFct = &SMPlayerPaddle; // Function pointer for the tick.
+
+	// Task 4
+	task4.state = 0;//Task initial state.
+	task4.period = SMEnemyPaddle_period;//Task Period.
+	task4.elapsedTime = SMEnemyPaddle_period; // Task current elasped time.
+	task4.TickFct = &SMEnemyPaddle; // Function pointer for the tick.
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Runs one scheduler period: ticks every task that is due
+//Parameter: None
+//Returns: Nothing, the caller waits for TimerFlag before calling again
+void SchedulerTick()
+{
+	unsigned short i; // Scheduler for-loop iterator
+	signed char next; // State returned by a tick, compared against the old one for telemetry
+	unsigned char overran = 0; // Set once an overrun has been reported for this tick
+
+	for ( i = 0; i < numTasks; i++ ) {
+		// Task is ready to tick
+		if ( tasks[i]->elapsedTime == tasks[i]->period ) {
+			// Setting next state for task
+			next = tasks[i]->TickFct(tasks[i]->state);
+			// The display walks PlayerOutput/BallOutput/EnemyOutput every tick, only report leaving that loop
+			if ( next != tasks[i]->state && ( i != 0 || next < PlayerOutput || next > EnemyOutput
+					|| tasks[i]->state < PlayerOutput || tasks[i]->state > EnemyOutput ) ) {
+				TlmEvent(Tlm_state, i, 1, next, 0, 0);
+			}
+			tasks[i]->state = next;
+			// Reset the elapsed time for next tick.
+			tasks[i]->elapsedTime = 0;
+		}
+		tasks[i]->elapsedTime += 1;
+		// TimerFlag already set means the next tick came due while this task ran
+		if ( TimerFlag && !overran ) {
+			overran = 1;
+			TlmEvent(Tlm_overrun, i, 0, 0, 0, 0);
+		}
+	}
+	TlmTime += GCD;
+}
+//--------End Scheduler-------------------------------------------------------
+
+//--------Power---------------------------------------------------------------
+// With no button down for ATTRACT_MS the game is put aside and a demo plays
+// itself: the Autonomous AI on the enemy side, a simple follower on the
+// player side, the matrix lit one ms in four and the CPU in idle sleep
+// between the 1 ms ticks. After SLEEP_MS the main loop
+// darkens everything and puts the CPU into power-down; only a pin change on
+// PORTC (any button) wakes it. The first button down, in the demo or out of
+// sleep, puts the saved game back exactly as it was, within the same ms.
+// Power-down keeps SRAM and registers, so nothing else has to be restored.
+// For a wake-up well inside one 15 ms frame the start-up time fuses (SUT)
+// should be set to 6 CK + 14 CK (+ 0 ms or 4.1 ms), not 65 ms.
+#define ATTRACT_MS 30000
+#define SLEEP_MS 120000
+
+unsigned char PowerDown = 0x00;		// Set by PowerTick, the main loop sleeps
+
+struct _saved_game {
+	unsigned char player, enemy;
+	unsigned char player_score, enemy_score;
+	unsigned char autonomous, index_x;
+	unsigned long i, dumbifier;
+	entity entities[MAX_ENTITIES];
+	unsigned char mode, draw;
+	unsigned char leds;
+	signed char state[4];
+	unsigned long elapsed[4];
+	row_t text_rows[FONT_HEIGHT];
+	const char *text_pos;
+	unsigned char text_column, text_tail, text_time, text_row, text_active;
+} SavedGame;
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Copies the game, task states and text included, to SavedGame
+//Parameter: None
+//Returns: None
+void GameSave() {
+	unsigned char n;
+
+	SavedGame.player = PlayerPaddlePosition;
+	SavedGame.enemy = EnemyPaddlePosition;
+	SavedGame.player_score = PlayerScore;
+	SavedGame.enemy_score = EnemyScore;
+	SavedGame.autonomous = Autonomous;
+	SavedGame.index_x = indexXpos;
+	SavedGame.i = i;
+	SavedGame.dumbifier = AIdumbifier;
+	for(n = 0; n < MAX_ENTITIES; n++){
+		SavedGame.entities[n] = Entities[n];
+	}
+	SavedGame.mode = GameMode;
+	SavedGame.draw = DrawIndex;
+	SavedGame.leds = PORTD;
+	for(n = 0; n < numTasks; n++){
+		SavedGame.state[n] = tasks[n]->state;
+		SavedGame.elapsed[n] = tasks[n]->elapsedTime;
+	}
+	for(n = 0; n < FONT_HEIGHT; n++){
+		SavedGame.text_rows[n] = TextRows[n];
+	}
+	SavedGame.text_pos = TextPos;
+	SavedGame.text_column = TextColumn;
+	SavedGame.text_tail = TextTail;
+	SavedGame.text_time = TextTime;
+	SavedGame.text_row = TextRow;
+	SavedGame.text_active = TextActive;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Puts the game saved by GameSave back
+//Parameter: None
+//Returns: None
+void GameRestore() {
+	unsigned char n;
+
+	PlayerPaddlePosition = SavedGame.player;
+	EnemyPaddlePosition = SavedGame.enemy;
+	PlayerScore = SavedGame.player_score;
+	EnemyScore = SavedGame.enemy_score;
+	Autonomous = SavedGame.autonomous;
+	indexXpos = SavedGame.index_x;
+	i = SavedGame.i;
+	AIdumbifier = SavedGame.dumbifier;
+	for(n = 0; n < MAX_ENTITIES; n++){
+		Entities[n] = SavedGame.entities[n];
+	}
+	GameMode = SavedGame.mode;
+	DrawIndex = SavedGame.draw;
+	PORTD = SavedGame.leds;
+	for(n = 0; n < numTasks; n++){
+		tasks[n]->state = SavedGame.state[n];
+		tasks[n]->elapsedTime = SavedGame.elapsed[n];
+	}
+	//The text too: a demo message must not scroll on over the game
+	for(n = 0; n < FONT_HEIGHT; n++){
+		TextRows[n] = SavedGame.text_rows[n];
+	}
+	TextPos = SavedGame.text_pos;
+	TextColumn = SavedGame.text_column;
+	TextTail = SavedGame.text_tail;
+	TextTime = SavedGame.text_time;
+	TextRow = SavedGame.text_row;
+	TextActive = SavedGame.text_active;
+	//The button that woke the game counts as held: the mode only changes
+	//on a fresh press, whatever was down when the demo started or slept
+	if((~PINC&0x80) == 0x80){
+		ModeHeld = 0x01;
+	}
+	else{
+		ModeHeld = 0x00;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Watches the buttons; starts and ends the demo, asks for sleep.
+//                The main loop calls it after every SchedulerTick
+//Parameter: None
+//Returns: None
+void PowerTick() {
+	if(PINC != 0xFF){
+		if(Attract == 0x01){
+			GameRestore();
+			Attract = 0x00;
+		}
+		IdleTime = 0;
+		return;
+	}
+	if(IdleTime < SLEEP_MS){
+		IdleTime++;
+	}
+	if(IdleTime == ATTRACT_MS){
+		GameSave();
+		Attract = 0x01;
+		Autonomous = 0x01;
+	}
+	else if(IdleTime == SLEEP_MS){
+		PowerDown = 0x01;
+#if DISPLAY_SPI
+		if(SpiBusy){
+			PowerDown = 0x00;	// Next ms: the shutdown command has to go out on its own
+		}
+#endif
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Darkens the outputs and arms the pin change wake-up; the
+//                caller then executes SLEEP
+//Parameter: None
+//Returns: None
+void PowerDownEnter() {
+	MATRIX_COLS = 0x00;
+	MATRIX_ROWS = ALL_ROWS;
+	PORTD = 0x00;
+#if DISPLAY_SPI
+	SpiStart(PanelCommand(0, 0x0C, 0x00));	// Every module into shutdown
+#endif
+	PCMSK2 = 0xFF;	// PCINT23:16 are PC7:0, every button
+	PCIFR = 0x04;	// bit2 PCIF2: forget edges from before
+	PCICR |= 0x04;	// bit2 PCIE2
+	SMCR = 0x05;	// bit3:1 SM=010 power-down, bit0 SE
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Undoes PowerDownEnter after the wake-up; PowerTick restores
+//                the game when it sees the button
+//Parameter: None
+//Returns: None
+void PowerWake() {
+#if DISPLAY_SPI
+	unsigned char row;
+
+#endif
+	SMCR = 0x00;
+	PCICR &= ~0x04;
+	TCNT1 = 0;		// Full 1 ms to the next tick
+	TimerFlag = 0;
+#if DISPLAY_SPI
+	PanelOn();
+	// The half frame from before the power-down is stale, start a new one
+	for(row = 0; row < BOARD_HEIGHT; row++){
+		PanelAcc[row] = 0x00;
+	}
+	PanelTime = 0;
+#endif
+	PowerDown = 0x00;
+}
+
+// Only here to wake the CPU, PowerTick sees the button
+ISR(PCINT2_vect)
+{
+}
+//--------End Power-----------------------------------------------------------
+
+// The host build (gcc -DHOST_BUILD -Ihost) drives SchedulerTick() itself, see host/sim.c
+#ifndef HOST_BUILD
+//--------Stack watermark-----------------------------------------------------
+// Before main() runs, every byte between the end of .bss and the stack pointer
+// is painted with STACK_PAINT. StackScan() runs in the idle time of the main
+// loop and walks up from the bottom one byte per call; the first byte that is
+// no longer paint is as deep as the stack (ISRs included) has ever gone. Each
+// new low is sent as a Tlm_stack event; holding Restart and pressing Mode
+// scrolls it across the board ("SP 01234"), for builds without telemetry.
+#define STACK_PAINT 0xC5
+
+extern unsigned char __heap_start;	// Linker symbol: first byte after .bss
+
+unsigned char *StackCursor = &__heap_start;
+
+#define STACK_STRING(x) #x
+#define STACK_ASM(x) STACK_STRING(x)	// STACK_PAINT as text for the asm below
+
+void StackPaint(void) __attribute__((naked, used, section(".init3")));
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Paints the free SRAM; runs from .init3, after the stack
+//                pointer is set and before .data/.bss are set up. A naked
+//                function gets no prologue, so it is asm only: C here would
+//                depend on the compiler never spilling to the stack.
+//Parameter: None
+//Returns: None
+void StackPaint(void) {
+	__asm__ __volatile__ (
+		"	ldi r30, lo8(__heap_start)\n"	// Z: first byte after .bss
+		"	ldi r31, hi8(__heap_start)\n"
+		"	ldi r24, " STACK_ASM(STACK_PAINT) "\n"
+		"	in r26, __SP_L__\n"	// X: stack pointer, nothing pushed yet
+		"	in r27, __SP_H__\n"
+		"1:	cp r30, r26\n"
+		"	cpc r31, r27\n"
+		"	brsh 2f\n"	// Z >= X: done
+		"	st Z+, r24\n"
+		"	rjmp 1b\n"
+		"2:\n"
+	);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Functionality - Checks one byte of the painted area
+//Parameter: None
+//Returns: None
+void StackScan() {
+	unsigned short untouched;
+
+	if((*StackCursor == STACK_PAINT) && (StackCursor < (unsigned char *)SP)){
+		StackCursor++;
+		return;
+	}
+	untouched = StackCursor - &__heap_start;
+	if(untouched < StackFree){
+		StackFree = untouched;
+		TlmEvent(Tlm_stack, 0, 2, untouched >> 8, untouched & 0xFF, 0);
+	}
+	StackCursor = &__heap_start;
+}
+//--------End Stack watermark-------------------------------------------------
+
 // Implement scheduler code from PES.
 int main()
 {
@@ -939,77 +1920,54 @@ DDRD = 0xFF; PORTD = 0x00;
 // . . . etc
 PORTA = 0xFF;
 
-// Period for the tasks
-unsigned long int SMDisplay_calc = 1;
-unsigned long int SMBall_calc = 100;
-unsigned long int SMPlayerPaddle_calc = 25;
-unsigned long int SMEnemyPaddle_calc = 25;
-
-//Calculating GCD
-unsigned long int tmpGCD = 1;
-tmpGCD = findGCD(SMDisplay_calc, SMBall_calc);
-tmpGCD = findGCD(tmpGCD, SMPlayerPaddle_calc);
-tmpGCD = findGCD(tmpGCD, SMEnemyPaddle_calc);
-
-//Greatest common divisor for all tasks or smallest time unit for tasks.
-unsigned long int GCD = tmpGCD;
-
-//Recalculate GCD periods for scheduler
-unsigned long int SMDisplay_period = SMDisplay_calc/GCD;
-unsigned long int SMBall_period = SMBall_calc/GCD;
-unsigned long int SMPlayerPaddle_period = SMPlayerPaddle_calc/GCD;
-unsigned long int SMEnemyPaddle_period = SMEnemyPaddle_calc/GCD;
-
-//Declare an array of tasks 
-static task task1, task2, task3, task4;
-task *tasks[] = { &task1, &task2, &task3, &task4 };
-const unsigned short numTasks = sizeof(tasks)/sizeof(task*);
-
-// Task 1
-task1.state = 0;//Task initial state.
-task1.period = SMDisplay_period;//Task Period.
-task1.elapsedTime = SMDisplay_period;//Task current elapsed time.
-task1.TickFct = &SMDisplay;//Function pointer for the tick.
-
-// Task 2
-task2.state = 0;//Task initial state.
-task2.period = SMBall_period;//Task Period.
-task2.elapsedTime = SMBall_period;//Task current elapsed time.
-task2.TickFct = &SMBall;//Function pointer for the tick.
-
-// Task 3
-task3.state = 0;//Task initial state.
-task3.period = SMPlayerPaddle_period;//Task Period.
-task3.elapsedTime = SMPlayerPaddle_period; // Task current elasped time.
-task3.TickFct = &SMPlayerPaddle; // Function pointer for the tick.
-
-// Task 4
-task4.state = 0;//Task initial state.
-task4.period = SMEnemyPaddle_period;//Task Period.
-task4.elapsedTime = SMEnemyPaddle_period; // Task current elasped time.
-task4.TickFct = &SMEnemyPaddle; // Function pointer for the tick.
+SchedulerInit();
 
 // Set the timer and turn it on
 TimerSet(GCD);
 TimerOn();
+TlmOn();
+#if DISPLAY_SPI
+PanelOn();
+#endif
 
-unsigned short i; // Scheduler for-loop iterator
 while(1) {
 	// Scheduler code
-	for ( i = 0; i < numTasks; i++ ) {
-		// Task is ready to tick
-		if ( tasks[i]->elapsedTime == tasks[i]->period ) {
-			// Setting next state for task
-			tasks[i]->state = tasks[i]->TickFct(tasks[i]->state);
-			// Reset the elapsed time for next tick.
-			tasks[i]->elapsedTime = 0;
+	SchedulerTick();
+	PowerTick();
+	if(PowerDown){
+		PowerDownEnter();
+#if DISPLAY_SPI
+		while(SpiBusy);	// Shutdown command out before the SPI clock stops
+#endif
+		// A button pressed since PowerTick looked must not be slept through;
+		// the instruction after SEI always runs, so no interrupt gets between
+		cli();
+		if(PINC == 0xFF){
+			sei();
+			__asm__ __volatile__ ("sleep");
 		}
-		tasks[i]->elapsedTime += 1;
+		sei();
+		PowerWake();
+	}
+	//Demo: the CPU sleeps in idle mode until Timer1 brings the next tick
+	//instead of spinning; the stack scan waits until the game is back
+	if(Attract == 0x01){
+		cli();
+		if(!TimerFlag){
+			SMCR = 0x01;	// bit3:1 SM=000 idle, Timer1 keeps running; bit0 SE
+			sei();
+			__asm__ __volatile__ ("sleep");
+			SMCR = 0x00;
+		}
+		sei();
+	}
+	while(!TimerFlag){
+		StackScan();
 	}
-	while(!TimerFlag);
 	TimerFlag = 0;
 }
 
 // Error: Program should not exit!
 return 0;
 }
+#endif